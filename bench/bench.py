@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""Benchmarks gcBB over the bundled datasets and a synthetic collection.
+
+gcBB is built in the work directory and every configuration (-a and -c,
+all-vs-all and coverage) is run over every dataset and k value. The
+time, CPU and memory of each step are read from the metrics JSON of the
+run (results/<name>_metrics.json) and written to a CSV file together
+with a checksum of the distance matrixes and BOSS files.
+
+If a baseline CSV exists, every step slower (or bigger) than the
+baseline by more than the tolerance, every checksum that changed and
+every run that stopped working is reported, and the exit status is 1.
+"""
+import argparse
+import csv
+import glob
+import hashlib
+import json
+import os
+import shutil
+import subprocess
+import sys
+import time
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BENCH = os.path.join(REPO, "bench")
+
+# k values of each dataset, the toy datasets have reads of length 6
+DATASETS = {
+    "dataset": [3, 5],
+    "cov_dataset": [3, 5],
+    "influenza_dataset": [16, 32],
+    "influenza_dataset_fasta": [16, 32],
+    "synthetic": [16, 32],
+}
+
+FIELDS = ["config", "dataset", "k", "step", "status", "wall_seconds", "cpu_seconds", "peak_rss_kb",
+          "child_cpu_seconds", "child_peak_rss_kb", "checksum"]
+
+
+def configName(allVsAll, coverage):
+    return "all%d_cov%d" % (allVsAll, coverage)
+
+
+def build(work):
+    directory = os.path.join(work, "build")
+    shutil.rmtree(directory, ignore_errors=True)
+    os.makedirs(os.path.join(directory, "lib"))
+    for source in glob.glob(os.path.join(REPO, "*.[ch]")) + [os.path.join(REPO, "Makefile")]:
+        shutil.copy(source, directory)
+    for source in glob.glob(os.path.join(REPO, "lib", "*.[ch]")):
+        shutil.copy(source, os.path.join(directory, "lib"))
+    subprocess.run(["make", "gcBB", "DEBUG=0"], cwd=directory, check=True, stdout=subprocess.DEVNULL)
+    return os.path.join(directory, "gcBB")
+
+
+def stepName(name):
+    # per pair and per input steps are summed over pairs and inputs
+    if name.startswith("Phase "):
+        return name[:len("Phase 1")]
+    if name.startswith("eGap ") and name != "eGap merge":
+        return "eGap inputs"
+    return name
+
+
+def checksum(results):
+    digest = hashlib.sha256()
+    for fileName in sorted(glob.glob(os.path.join(results, "*.dmat")) + glob.glob(os.path.join(results, "*.boss"))):
+        digest.update(os.path.basename(fileName).encode())
+        with open(fileName, "rb") as f:
+            for block in iter(lambda: f.read(1 << 20), b""):
+                digest.update(block)
+    return digest.hexdigest()[:16]
+
+
+def run(binary, allVsAll, coverage, datasetName, datasetPath, k, args):
+    config = configName(allVsAll, coverage)
+    directory = os.path.join(args.work, "run", config, datasetName, "k%d" % k)
+    shutil.rmtree(directory, ignore_errors=True)
+    os.makedirs(directory)
+    os.symlink(args.egap, os.path.join(directory, "egap"))
+    os.symlink(os.path.join(REPO, "utils"), os.path.join(directory, "utils"))
+    os.symlink(datasetPath, os.path.join(directory, datasetName))
+
+    command = [binary, datasetName + "/", "-k", str(k), "-m", str(args.memory), "-a", str(allVsAll), "-c", str(coverage)]
+    start = time.monotonic()
+    with open(os.path.join(directory, "stdout.txt"), "w") as log:
+        process = subprocess.Popen(command, cwd=directory, stdout=log, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(process.pid, 0)
+    wallTime = time.monotonic() - start
+    exitCode = os.waitstatus_to_exitcode(status)
+
+    results = os.path.join(directory, "results")
+    row = {"config": config, "dataset": datasetName, "k": k}
+    rows = [dict(row, step="total", status="ok" if exitCode == 0 else "exit %d" % exitCode,
+                 wall_seconds="%.6f" % wallTime, cpu_seconds="%.6f" % (usage.ru_utime + usage.ru_stime),
+                 peak_rss_kb=usage.ru_maxrss, child_cpu_seconds="", child_peak_rss_kb="",
+                 checksum=checksum(results) if exitCode == 0 else "")]
+
+    steps = {}
+    for metricsFile in glob.glob(os.path.join(results, "*_metrics.json")):
+        with open(metricsFile) as f:
+            phases = json.load(f)["phases"]
+        for phase in phases:
+            name = stepName(phase["name"])
+            step = steps.setdefault(name, {"wall": 0.0, "cpu": 0.0, "rss": 0, "childCpu": 0.0, "childRss": 0})
+            step["wall"] += phase["wall_seconds"]
+            step["cpu"] += phase["cpu_seconds"]
+            step["rss"] = max(step["rss"], phase["peak_rss_kb"])
+            step["childCpu"] += phase["children"]["cpu_seconds"]
+            step["childRss"] = max(step["childRss"], phase["children"]["peak_rss_kb"])
+    for name, step in steps.items():
+        rows.append(dict(row, step=name, status="ok", wall_seconds="%.6f" % step["wall"],
+                         cpu_seconds="%.6f" % step["cpu"], peak_rss_kb=step["rss"],
+                         child_cpu_seconds="%.6f" % step["childCpu"], child_peak_rss_kb=step["childRss"],
+                         checksum=""))
+
+    if not args.keep:
+        shutil.rmtree(os.path.join(directory, "tmp"), ignore_errors=True)
+    return rows
+
+
+def regressions(rows, baselineFile, tolerance, minSeconds):
+    with open(baselineFile) as f:
+        baseline = {(r["config"], r["dataset"], r["k"], r["step"]): r for r in csv.DictReader(f)}
+    found = []
+    for row in rows:
+        key = (row["config"], row["dataset"], str(row["k"]), row["step"])
+        old = baseline.get(key)
+        if old is None:
+            continue
+        where = "%s %s k=%s %s" % key
+        if old["status"] == "ok" and row["status"] != "ok":
+            found.append("%s: %s (was ok)" % (where, row["status"]))
+        if old["checksum"] and row["checksum"] and old["checksum"] != row["checksum"]:
+            found.append("%s: output checksum %s (was %s)" % (where, row["checksum"], old["checksum"]))
+        if row["status"] != "ok" or old["status"] != "ok":
+            continue
+        for field, floor in (("wall_seconds", minSeconds), ("cpu_seconds", minSeconds), ("peak_rss_kb", 1024)):
+            new, previous = float(row[field]), float(old[field])
+            if new > previous*(1+tolerance) and new-previous > floor:
+                found.append("%s: %s %s (was %s)" % (where, field, row[field], old[field]))
+    return found
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--datasets", default=",".join(DATASETS), help="comma separated dataset names")
+    parser.add_argument("--all-vs-all", default="1,0", help="-a values to run")
+    parser.add_argument("--coverage", default="0,1", help="-c values to run")
+    parser.add_argument("--k", help="comma separated k values, instead of the ones of each dataset")
+    parser.add_argument("--memory", type=int, default=2048, help="-m value given to gcBB")
+    parser.add_argument("--synthetic", default="8x100000", help="GENOMESxLENGTH of the synthetic collection")
+    parser.add_argument("--egap", default=os.path.join(REPO, "egap"), help="directory of the eGap executable")
+    parser.add_argument("--work", default=os.path.join(BENCH, "work"))
+    parser.add_argument("--output", default=os.path.join(BENCH, "results.csv"))
+    parser.add_argument("--baseline", default=os.path.join(BENCH, "baseline.csv"))
+    parser.add_argument("--update-baseline", action="store_true", help="store this run as the baseline")
+    parser.add_argument("--tolerance", type=float, default=0.25, help="relative slowdown reported as a regression")
+    parser.add_argument("--min-seconds", type=float, default=0.1, help="smaller slowdowns are never reported")
+    parser.add_argument("--keep", action="store_true", help="keep the tmp directory of each run")
+    args = parser.parse_args()
+    args.work = os.path.abspath(args.work)
+    args.egap = os.path.abspath(args.egap)
+
+    if not os.path.exists(os.path.join(args.egap, "eGap")):
+        sys.exit("eGap not found in %s, run make all first" % args.egap)
+
+    datasets = {}
+    for name in args.datasets.split(","):
+        if name == "synthetic":
+            genomes, length = args.synthetic.split("x")
+            path = os.path.join(args.work, "synthetic_%sx%s" % (genomes, length))
+            if not os.path.isdir(path):
+                subprocess.run([sys.executable, os.path.join(BENCH, "synthetic.py"), path,
+                                "--genomes", genomes, "--length", length], check=True)
+            datasets[name] = path
+        else:
+            datasets[name] = os.path.join(REPO, name)
+
+    rows = []
+    binary = build(args.work)
+    for allVsAll in map(int, args.all_vs_all.split(",")):
+        for coverage in map(int, args.coverage.split(",")):
+            for name, path in datasets.items():
+                ks = map(int, args.k.split(",")) if args.k else DATASETS[name]
+                for k in ks:
+                    print("%s %s k=%d" % (configName(allVsAll, coverage), name, k), flush=True)
+                    rows.extend(run(binary, allVsAll, coverage, name, path, k, args))
+
+    with open(args.output, "w", newline="") as f:
+        writer = csv.DictWriter(f, fieldnames=FIELDS)
+        writer.writeheader()
+        writer.writerows(rows)
+    print("Results written to %s" % args.output)
+
+    if args.update_baseline:
+        shutil.copy(args.output, args.baseline)
+        print("Baseline stored in %s" % args.baseline)
+        return 0
+    if not os.path.exists(args.baseline):
+        print("No baseline in %s, run make bench-baseline to store one" % args.baseline)
+        return 0
+
+    found = regressions(rows, args.baseline, args.tolerance, args.min_seconds)
+    for regression in found:
+        print("REGRESSION %s" % regression)
+    print("%d regressions against %s" % (len(found), args.baseline))
+    return 1 if found else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
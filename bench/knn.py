@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+"""Checks the nearest genomes of --knn against the whole distance matrix.
+
+gcBB is built as in bench.py and run over a dataset three times with -a 1
+and -c 0: without --knn, with --knn over every pair, and with --knn and
+--pairs listing every pair. The .knn files must hold the nearest genomes of
+each genome by the .dmat expectation, and some pairs must stop early: the
+stdout reports them, and the .pairs file has them as nan.
+"""
+import argparse
+import glob
+import itertools
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+from bench import BENCH, REPO, build
+
+
+def run(binary, name, datasetName, datasetPath, k, extra, args):
+    directory = os.path.join(args.work, "knn", name)
+    shutil.rmtree(directory, ignore_errors=True)
+    os.makedirs(directory)
+    os.symlink(args.egap, os.path.join(directory, "egap"))
+    os.symlink(os.path.join(REPO, "utils"), os.path.join(directory, "utils"))
+    os.symlink(datasetPath, os.path.join(directory, datasetName))
+    command = [binary, datasetName + "/", "-k", str(k), "-m", str(args.memory), "-a", "1", "-c", "0"] + extra
+    with open(os.path.join(directory, "stdout.txt"), "w") as log:
+        status = subprocess.run(command, cwd=directory, stdout=log, stderr=subprocess.STDOUT).returncode
+    with open(os.path.join(directory, "stdout.txt")) as log:
+        stdout = log.read()
+    if status != 0:
+        sys.exit("%s failed with exit %d, see %s/stdout.txt" % (name, status, directory))
+    return directory, stdout
+
+
+def readDmat(fileName):
+    with open(fileName) as f:
+        lines = [line.rstrip("\n") for line in f]
+    labels = lines[lines.index("[labels]")+1].split()
+    rows = [line.split() for line in lines[lines.index("[distances]")+1:] if line.strip()]
+    distance = {}
+    for i, row in enumerate(rows):
+        for j, value in enumerate(row):
+            distance[labels[i+1], labels[j]] = distance[labels[j], labels[i+1]] = float(value)
+    return labels, distance
+
+
+def readKnn(fileName):
+    neighbors = {}
+    with open(fileName) as f:
+        next(f)
+        for line in f:
+            genome, neighbor, expectation, _ = line.rstrip("\n").split("\t")
+            neighbors.setdefault(genome, []).append((neighbor, float(expectation)))
+    return neighbors
+
+
+def checkKnn(name, knnFile, labels, distance, knn):
+    found = readKnn(knnFile)
+    errors = 0
+    for genome in labels:
+        nearest = sorted(((distance[genome, other], other) for other in labels if other != genome))[:knn]
+        got = found.get(genome, [])
+        if [other for _, other in nearest] != [other for other, _ in got] or \
+                any(abs(value - expectation) > 1e-5 for (value, _), (_, expectation) in zip(nearest, got)):
+            print("%s: nearest genomes of %s are %s, expected %s" % (name, genome, got, nearest))
+            errors += 1
+    return errors
+
+
+def stoppedPairs(stdout):
+    return sum(int(count) for count in re.findall(r"(\d+) pairs stopped early", stdout))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--dataset", default="influenza_dataset_fasta")
+    parser.add_argument("--k", type=int, default=16)
+    parser.add_argument("--knn", type=int, default=1)
+    parser.add_argument("--memory", type=int, default=2048, help="-m value given to gcBB")
+    parser.add_argument("--egap", default=os.path.join(REPO, "egap"), help="directory of the eGap executable")
+    parser.add_argument("--work", default=os.path.join(BENCH, "work"))
+    args = parser.parse_args()
+    args.work = os.path.abspath(args.work)
+    args.egap = os.path.abspath(args.egap)
+
+    if not os.path.exists(os.path.join(args.egap, "eGap")):
+        sys.exit("eGap not found in %s, run make all first" % args.egap)
+
+    datasetPath = os.path.join(REPO, args.dataset)
+    binary = build(args.work)
+
+    full, _ = run(binary, "full", args.dataset, datasetPath, args.k, [], args)
+    labels, distance = readDmat(glob.glob(os.path.join(full, "results", "*_expectation_all_k_%d.dmat" % args.k))[0])
+
+    errors = 0
+    knn = ["--knn", str(args.knn)]
+    directory, stdout = run(binary, "knn", args.dataset, datasetPath, args.k, knn, args)
+    errors += checkKnn("--knn", glob.glob(os.path.join(directory, "results", "*.knn"))[0], labels, distance, args.knn)
+    if stoppedPairs(stdout) == 0:
+        print("--knn: no pair stopped early")
+        errors += 1
+
+    pairsFile = os.path.join(args.work, "knn", "pairs.txt")
+    with open(pairsFile, "w") as f:
+        for genome1, genome2 in itertools.combinations(labels, 2):
+            f.write("%s %s\n" % (genome1, genome2))
+    directory, stdout = run(binary, "knn-pairs", args.dataset, datasetPath, args.k, knn + ["--pairs", pairsFile], args)
+    errors += checkKnn("--knn --pairs", glob.glob(os.path.join(directory, "results", "*.knn"))[0], labels, distance, args.knn)
+    with open(glob.glob(os.path.join(directory, "results", "*.pairs"))[0]) as f:
+        stopped = [line for line in f if "nan" in line]
+    if not stopped or len(stopped) != stoppedPairs(stdout):
+        print("--knn --pairs: %d nan pairs, %d stopped early" % (len(stopped), stoppedPairs(stdout)))
+        errors += 1
+
+    print("%d pairs stopped early out of %d, %d errors" % (len(stopped), len(labels)*(len(labels)-1)//2, errors))
+    return 1 if errors else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,66 @@
+#!/usr/bin/env python3
+"""Writes a collection of related synthetic genomes as FASTQ reads.
+
+A random ancestor is mutated (substitutions and short indels) into each
+genome, and reads are sampled from both strands of every genome up to
+the requested coverage, so the BWSD between genomes grows with their
+mutation rate.
+"""
+import argparse
+import os
+import random
+
+BASES = "ACGT"
+COMPLEMENT = str.maketrans("ACGT", "TGCA")
+
+
+def mutate(rng, genome, rate):
+    out = []
+    for base in genome:
+        r = rng.random()
+        if r < rate*0.8:
+            out.append(rng.choice(BASES.replace(base, "")))
+        elif r < rate*0.9:
+            continue
+        elif r < rate:
+            out.append(base)
+            out.append(rng.choice(BASES))
+        else:
+            out.append(base)
+    return "".join(out)
+
+
+def writeReads(rng, genome, name, coverage, readLength, fileName):
+    reads = max(1, int(len(genome)*coverage/readLength))
+    quality = "I"*readLength
+    with open(fileName, "w") as output:
+        for i in range(reads):
+            start = rng.randint(0, max(0, len(genome)-readLength))
+            read = genome[start:start+readLength]
+            if rng.random() < 0.5:
+                read = read.translate(COMPLEMENT)[::-1]
+            output.write("@%s.%d\n%s\n+\n%s\n" % (name, i+1, read, quality[:len(read)]))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("output", help="directory of the FASTQ files")
+    parser.add_argument("--genomes", type=int, default=8)
+    parser.add_argument("--length", type=int, default=100000, help="ancestor length")
+    parser.add_argument("--mutation", type=float, default=0.01, help="mutation rate of each genome")
+    parser.add_argument("--coverage", type=float, default=10.0)
+    parser.add_argument("--read-length", type=int, default=100)
+    parser.add_argument("--seed", type=int, default=1)
+    args = parser.parse_args()
+
+    rng = random.Random(args.seed)
+    os.makedirs(args.output, exist_ok=True)
+    ancestor = "".join(rng.choice(BASES) for _ in range(args.length))
+    for g in range(args.genomes):
+        name = "genome%02d" % (g+1)
+        genome = mutate(rng, ancestor, args.mutation*(g+1)/args.genomes)
+        writeReads(rng, genome, name, args.coverage, args.read_length, os.path.join(args.output, name + ".fastq"))
+
+
+if __name__ == "__main__":
+    main()
@@ -1,12 +1,76 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
+#include <limits.h>
+#include <pthread.h>
 #include "boss.h"
 #include "external.h"
+#include "bossfile.h"
+#include "manifest.h"
+#include "chunkfile.h"
 
 #define FILE_PATH 1024
 #define ALPHABET_SIZE 255
+#define SEGMENT_SEARCH (1 << 16)
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+// position of the (genome, symbol) pair in the samples x ALPHABET_SIZE frequency tables
+#define SAMPLE_SYMBOL(da, bwt) ((da)*ALPHABET_SIZE + (bwt))
+
+struct bossBuilder {
+    int k;
+    int skip; // BOSS for this k was already computed
+    uint64_t key; // manifest key of the BOSS file
+
+    // BOSS result files, packed into bossFileName once construction ends
+    char bossFileName[FILE_PATH];
+    char bossLast[FILE_PATH];
+    char bossW[FILE_PATH];
+    char bossWm[FILE_PATH];
+    char bossColors[FILE_PATH];
+    char bossCoverage[FILE_PATH];
+    char bossSummarizedLCP[FILE_PATH];
+    char bossSummarizedSL[FILE_PATH];
+    char bossColorRuns[FILE_PATH];
+    char bossSLFlags[FILE_PATH];
+    char bossLCPFlags[FILE_PATH];
+
+    FILE *bossLastFile, *bossWFile, *bossWmFile;
+    FILE *bossColorsFile, *bossCoverageFile, *bossSummarizedLCPFile, *bossSummarizedSLFile, *bossColorRunsFile;
+    FILE *bossSLFlagsFile, *bossLCPFlagsFile;
+    bossColorRun colorRun; // last run of the colors of the (k+1)-mers, not written yet
+    uint64_t SLFlags, LCPFlags; // flags of the last flagBits edges, not written yet
+    int flagBits;
+
+    // Wi range being constructed
+    int WiSize, WiCapacity;
+    short *last;
+    char *W;
+    short *Wm;
+    short *colors;
+    int *coverage;
+    unsigned char *coverageBytes; // varints of coverage
+    short *summarizedLCP;
+    short *summarizedSL;
+
+    unsigned long i; // BOSS length
+    unsigned long C[ALPHABET_SIZE];
+
+    // BOSS construction auxiliary variables 
+    int WFreq[ALPHABET_SIZE]; // frequency of outgoing edges in a (k-1)-mer suffix range (detects W- = 1)
+    int WiFreq[ALPHABET_SIZE]; // frequency of outgoing edges in a k-mer suffix range (detects same outgoing edge in a vertex)
+    int solidWFreq[ALPHABET_SIZE]; // frequency of outgoing edges kept by the solid k-mer filter in a (k-1)-mer suffix range
+    int *WiFirstOccurrence; // first occurence of an outgoing edge in a k-mer suffix range from a string collection
+    int *DAFreq; // frequency of outgoing edges in a k-mer from a string collection (used to include same outgoing edge from distinct collections in BOSS representation)
+    int *dummiesFreq; // frequency of outgoing edges from dummy inputs of size 1 ($)
+    short carryLCP; // LCP of a vertex entirely dropped by the solid k-mer filter
+    unsigned long droppedEdges;
+
+    size_t *totalSampleColorsInBoss;
+    size_t *totalSampleCoverageInBoss;
+};
 
 typedef struct {
     char W;
@@ -56,7 +120,44 @@ void fixWiLCP(char *W, short *summarizedLCP, int k, int WiSize){
     }
 }
 
-void addEdge(char *W, short **last, short *colors, short *summarizedLCP, short *summarizedSL, int freq, short *Wm, char bwt, char da, short lcp, short sl, int WiSize, int edgeStatus){
+int solidFilter(char *W, short *last, short *Wm, short *colors, int *coverage, short *summarizedLCP, short *summarizedSL, int WiSize, int k, int minAbundance, int *solidWFreq, short *carryLCP, unsigned long *C, size_t *totalSampleColorsInBoss, size_t *totalSampleCoverageInBoss){
+    int x, kept = 0;
+    short firstLCP = MIN(summarizedLCP[0], *carryLCP);
+
+    for(x = 0; x < WiSize; x++){
+        if(coverage[x] < minAbundance){
+            // edge only seen in a few reads of its genome, most likely a sequencing error
+            C[W[x]]--;
+            totalSampleColorsInBoss[colors[x]]--;
+            totalSampleCoverageInBoss[colors[x]] -= coverage[x];
+            continue;
+        }
+        W[kept] = W[x];
+        colors[kept] = colors[x];
+        coverage[kept] = coverage[x];
+        summarizedSL[kept] = summarizedSL[x];
+        last[kept] = 0;
+        // W- must be recomputed since the first edge with this label in the (k-1)-mer may have been dropped
+        Wm[kept] = solidWFreq[W[kept]] == 0 ? 1 : 0;
+        solidWFreq[W[kept]]++;
+        kept++;
+    }
+
+    if(kept == 0){
+        // the whole vertex was dropped, the next kept edge inherits its LCP with the previous vertex
+        *carryLCP = firstLCP;
+        return 0;
+    }
+
+    last[kept-1] = 1;
+    summarizedLCP[0] = firstLCP;
+    fixWiLCP(W, summarizedLCP, k, kept);
+    *carryLCP = SHRT_MAX;
+
+    return kept;
+}
+
+void addEdge(char *W, short **last, short *colors, short *summarizedLCP, short *summarizedSL, int freq, short *Wm, char bwt, short da, short lcp, short sl, int WiSize, int edgeStatus){
     *W = bwt;
     *colors = da;
     *summarizedLCP = lcp;
@@ -80,251 +181,406 @@ void addEdge(char *W, short **last, short *colors, short *summarizedLCP, short *
     }
 }
 
-void bossConstruction(FILE *mergeLCP, FILE *mergeDA, FILE *mergeBWT, FILE *mergeSL, size_t n, int k, int samples, int mem, char* file1, char* file2, int printBoss){
-    // Iterators
-    unsigned long i = 0; // iterates through Wi
-    int j = 0;
-    size_t bi = 0; // iterates through BWT, LCP, SL and DA 
-    int lcpBlockPos = 0; // iterates through LCP memory blocks
-    int otherBlocksPos = 1; // iterates through BWT, SL and DA memory blocks
-
-    // Count computation time
-    clock_t start, end;
-    double cpuTimeUsed;
+uint64_t bossKey(uint64_t mergeKey, int k, int samples, int minAbundance){
+    return manifestKey("BOSS %016lx k %d samples %d s %d version %d", mergeKey, k, samples, minAbundance, BOSS_FILE_VERSION);
+}
 
-    start = clock();
+/* Adds count flags of edges (the lowest bits of SLFlags and LCPFlags, the
+   others are 0) to the flag bitvectors of b */
+static void addFlags(bossBuilder *b, uint64_t SLFlags, uint64_t LCPFlags, int count){
+    int bits = b->flagBits;
+    if(count == 0)
+        return;
+    b->SLFlags |= SLFlags << bits;
+    b->LCPFlags |= LCPFlags << bits;
+    if(bits+count < 64){
+        b->flagBits += count;
+        return;
+    }
+    fwrite(&b->SLFlags, sizeof(uint64_t), 1, b->bossSLFlagsFile);
+    fwrite(&b->LCPFlags, sizeof(uint64_t), 1, b->bossLCPFlagsFile);
+    b->SLFlags = bits ? SLFlags >> (64-bits) : 0;
+    b->LCPFlags = bits ? LCPFlags >> (64-bits) : 0;
+    b->flagBits = bits+count-64;
+}
 
-    // LCP, SL, DA and BWT blocks needed for BOSS construction
-    short *LCP = (short*)calloc((mem+2), sizeof(short));
-    short *SL = (short*)calloc((mem+3), sizeof(short));
-    char *DA = (char*)calloc((mem+3), sizeof(char));
-    char *BWT = (char*)calloc((mem+3), sizeof(char));
+// Adds length (k+1)-mers of color to the color runs of b
+static void addColorRun(bossBuilder *b, short color, size_t length){
+    while(length > 0){
+        if(b->colorRun.length > 0 && (b->colorRun.color != color || b->colorRun.length == BOSS_COLOR_RUN_MAX)){
+            fwrite(&b->colorRun, sizeof(bossColorRun), 1, b->bossColorRunsFile);
+            b->colorRun.length = 0;
+        }
+        size_t added = MIN(length, (size_t)(BOSS_COLOR_RUN_MAX-b->colorRun.length));
+        b->colorRun.color = color;
+        b->colorRun.length += added;
+        length -= added;
+    }
+}
 
-    fread(LCP, sizeof(short), mem+1, mergeLCP);
-    fread(SL+1, sizeof(short), mem+1, mergeSL);
-    fread(DA+1, sizeof(char), mem+1, mergeDA);
-    fread(BWT+1, sizeof(char), mem+1, mergeBWT);
-    for(j = 1; j < mem+3; j++) BWT[j] = (BWT[j] == 0) ? '$' : BWT[j];
+// Opens the BOSS result files of b and allocates its construction variables
+static void bossBuilderOpen(bossBuilder *b, int samples){
+    int j;
+    b->bossLastFile = fopen(b->bossLast, "wb");
+    b->bossWFile = fopen(b->bossW, "wb");
+    b->bossWmFile = fopen(b->bossWm, "wb");
 
-    // BOSS result files
-    char bossLast[FILE_PATH];
-    char bossW[FILE_PATH];
-    char bossWm[FILE_PATH];
-    char bossColors[FILE_PATH];
-    char bossCoverage[FILE_PATH];
-    char bossSummarizedLCP[FILE_PATH];
-    char bossSummarizedSL[FILE_PATH];
+    b->bossColorsFile = fopen(b->bossColors, "wb");
+    b->bossCoverageFile = fopen(b->bossCoverage, "wb");
+    b->bossSummarizedLCPFile = fopen(b->bossSummarizedLCP, "wb");
+    b->bossSummarizedSLFile = fopen(b->bossSummarizedSL, "wb");
+    b->bossColorRunsFile = fopen(b->bossColorRuns, "wb");
+    b->bossSLFlagsFile = fopen(b->bossSLFlags, "wb");
+    b->bossLCPFlagsFile = fopen(b->bossLCPFlags, "wb");
 
-    #if ALL_VS_ALL
-        snprintf(bossLast, FILE_PATH, "results/%s_k_%d.2.last", file1, k);
-        snprintf(bossW, FILE_PATH, "results/%s_k_%d.1.W", file1, k);
-        snprintf(bossWm, FILE_PATH, "results/%s_k_%d.2.Wm", file1, k);
-        snprintf(bossColors, FILE_PATH, "results/%s_k_%d.2.colors", file1, k);
-        snprintf(bossCoverage, FILE_PATH, "results/%s_k_%d.4.coverage", file1, k);
-        snprintf(bossSummarizedLCP, FILE_PATH, "results/%s_k_%d.2.summarizedLCP", file1, k);
-        snprintf(bossSummarizedSL, FILE_PATH, "results/%s_k_%d.2.summarizedSL", file1, k);
-    #else
-        snprintf(bossLast, FILE_PATH, "results/%s-%s_k_%d.2.last", file1, file2, k);
-        snprintf(bossW, FILE_PATH, "results/%s-%s_k_%d.1.W", file1, file2, k);
-        snprintf(bossWm, FILE_PATH, "results/%s-%s_k_%d.2.Wm", file1, file2, k);
-        snprintf(bossColors, FILE_PATH, "results/%s-%s_k_%d.2.colors", file1, file2, k);
-        snprintf(bossCoverage, FILE_PATH, "results/%s-%s_k_%d.4.coverage", file1, file2, k);
-        snprintf(bossSummarizedLCP, FILE_PATH, "results/%s-%s_k_%d.2.summarizedLCP", file1, file2, k);
-        snprintf(bossSummarizedSL, FILE_PATH, "results/%s-%s_k_%d.2.summarizedSL", file1, file2, k);
-    #endif
-
-
-    #if ALL_VS_ALL
-        FILE *bossColorsFileExists = fopen(bossColors, "r");
-        if(bossColorsFileExists){
-            printf("BOSS needed files already computed\n");
-            fclose(bossColorsFileExists);
-            free(LCP); free(BWT); free(DA); free(SL);
-            return;
-        }
-    #endif
-    
-    FILE *bossLastFile = fopen(bossLast, "wb");
-    FILE *bossWFile = fopen(bossW, "wb");
-    FILE *bossWm_file = fopen(bossWm, "wb");
-    
-    FILE *bossColorsFile = fopen(bossColors, "wb");
-    FILE *bossCoverageFile = fopen(bossCoverage, "wb");
-    FILE *bossSummarizedLCPFile = fopen(bossSummarizedLCP, "wb");
-    FILE *bossSummarizedSLFile = fopen(bossSummarizedSL, "wb");
+    // a vertex has at most one outgoing edge per symbol ($,A,C,G,N,T) and genome
+    b->WiCapacity = MAX(200, 6*samples);
 
     // BOSS construction variables
-    short *last = (short*)calloc(200, sizeof(short));
-    char *W = (char*)calloc(200, sizeof(char));
-    short *Wm = (short*)calloc(200,sizeof(short));
-    short *colors = (short*)calloc(200, sizeof(short));
-    int *coverage = (int*)calloc(200, sizeof(int));
-    short *summarizedLCP = (short*)calloc(200, sizeof(short));
-    short *summarizedSL = (short*)calloc(200, sizeof(short));
+    b->last = (short*)calloc(b->WiCapacity, sizeof(short));
+    b->W = (char*)calloc(b->WiCapacity, sizeof(char));
+    b->Wm = (short*)calloc(b->WiCapacity, sizeof(short));
+    b->colors = (short*)calloc(b->WiCapacity, sizeof(short));
+    b->coverage = (int*)calloc(b->WiCapacity, sizeof(int));
+    b->coverageBytes = (unsigned char*)malloc(BOSS_COVERAGE_MAX_BYTES*b->WiCapacity);
+    b->summarizedLCP = (short*)calloc(b->WiCapacity, sizeof(short));
+    b->summarizedSL = (short*)calloc(b->WiCapacity, sizeof(short));
 
-    for(j = 0; j < 200; j++) coverage[j] = 1;
+    for(j = 0; j < b->WiCapacity; j++) b->coverage[j] = 1;
 
-    unsigned long C[ALPHABET_SIZE] = { 0 };
+    b->WiFirstOccurrence = calloc(samples*ALPHABET_SIZE, sizeof(int));
+    b->DAFreq = calloc(samples*ALPHABET_SIZE, sizeof(int));
+    b->dummiesFreq = calloc(samples*ALPHABET_SIZE, sizeof(int));
 
-    // BOSS construction auxiliary variables 
-    int WiSize = 0; 
-    int WFreq[ALPHABET_SIZE] = { 0 }; // frequency of outgoing edges in a (k-1)-mer suffix range (detects W- = 1)
-    int WiFreq[ALPHABET_SIZE] = { 0 }; // frequency of outgoing edges in a k-mer suffix range (detects same outgoing edge in a vertex)
-    int WiFirstOccurrence[samples][ALPHABET_SIZE]; // first occurence of an outgoing edge in a k-mer suffix range from a string collection
-    memset(WiFirstOccurrence, 0,  sizeof(int)*samples*ALPHABET_SIZE);
-    int DAFreq[samples][ALPHABET_SIZE]; // frequency of outgoing edges in a k-mer from a string collection (used to include same outgoing edge from distinct collections in BOSS representation)
-    memset(DAFreq, 0,  sizeof(int)*samples*ALPHABET_SIZE);
+    b->carryLCP = SHRT_MAX;
 
-    int dummiesFreq[samples][ALPHABET_SIZE]; // frequency of outgoing edges from dummy inputs of size 1 ($)
-    memset(dummiesFreq, 0,  sizeof(int)*samples*ALPHABET_SIZE);
+    b->totalSampleColorsInBoss = calloc(samples, sizeof(size_t));
+    b->totalSampleCoverageInBoss = calloc(samples, sizeof(size_t));
+}
 
-    size_t *totalSampleColorsInBoss = calloc(samples, sizeof(size_t));
-    size_t *totalSampleCoverageInBoss = calloc(samples, sizeof(size_t));
+bossBuilder* bossBuilderCreate(int k, int samples, char* file1, char* file2, uint64_t mergeKey, int minAbundance){
+    bossBuilder *b = calloc(1, sizeof(bossBuilder));
+    b->k = k;
 
-    while(bi < n){
+    // BOSS result files
+    if(runMode.allVsAll){
+        snprintf(b->bossFileName, FILE_PATH, "%s/%s_k_%d.boss", outDir, file1, k);
+        snprintf(b->bossLast, FILE_PATH, "%s/%s_k_%d.2.last", outDir, file1, k);
+        snprintf(b->bossW, FILE_PATH, "%s/%s_k_%d.1.W", outDir, file1, k);
+        snprintf(b->bossWm, FILE_PATH, "%s/%s_k_%d.2.Wm", outDir, file1, k);
+        snprintf(b->bossColors, FILE_PATH, "%s/%s_k_%d.2.colors", outDir, file1, k);
+        snprintf(b->bossCoverage, FILE_PATH, "%s/%s_k_%d.1.coverage", outDir, file1, k);
+        snprintf(b->bossSummarizedLCP, FILE_PATH, "%s/%s_k_%d.2.summarizedLCP", outDir, file1, k);
+        snprintf(b->bossSummarizedSL, FILE_PATH, "%s/%s_k_%d.2.summarizedSL", outDir, file1, k);
+        snprintf(b->bossColorRuns, FILE_PATH, "%s/%s_k_%d.4.colorRuns", outDir, file1, k);
+        snprintf(b->bossSLFlags, FILE_PATH, "%s/%s_k_%d.8.SLFlags", outDir, file1, k);
+        snprintf(b->bossLCPFlags, FILE_PATH, "%s/%s_k_%d.8.LCPFlags", outDir, file1, k);
+    } else {
+        snprintf(b->bossFileName, FILE_PATH, "%s/%s-%s_k_%d.boss", outDir, file1, file2, k);
+        snprintf(b->bossLast, FILE_PATH, "%s/%s-%s_k_%d.2.last", outDir, file1, file2, k);
+        snprintf(b->bossW, FILE_PATH, "%s/%s-%s_k_%d.1.W", outDir, file1, file2, k);
+        snprintf(b->bossWm, FILE_PATH, "%s/%s-%s_k_%d.2.Wm", outDir, file1, file2, k);
+        snprintf(b->bossColors, FILE_PATH, "%s/%s-%s_k_%d.2.colors", outDir, file1, file2, k);
+        snprintf(b->bossCoverage, FILE_PATH, "%s/%s-%s_k_%d.1.coverage", outDir, file1, file2, k);
+        snprintf(b->bossSummarizedLCP, FILE_PATH, "%s/%s-%s_k_%d.2.summarizedLCP", outDir, file1, file2, k);
+        snprintf(b->bossSummarizedSL, FILE_PATH, "%s/%s-%s_k_%d.2.summarizedSL", outDir, file1, file2, k);
+        snprintf(b->bossColorRuns, FILE_PATH, "%s/%s-%s_k_%d.4.colorRuns", outDir, file1, file2, k);
+        snprintf(b->bossSLFlags, FILE_PATH, "%s/%s-%s_k_%d.8.SLFlags", outDir, file1, file2, k);
+        snprintf(b->bossLCPFlags, FILE_PATH, "%s/%s-%s_k_%d.8.LCPFlags", outDir, file1, file2, k);
+    }
 
-        // read next block
-        if(bi != 0 && lcpBlockPos%mem == 0){
-            LCP[0] = LCP[mem];
-            fread(LCP+1, sizeof(short), mem, mergeLCP);
+    b->key = bossKey(mergeKey, k, samples, minAbundance);
+    if(manifestValid(b->bossFileName, b->key)){
+        printf("BOSS file for k = %d already computed\n", k);
+        b->skip = 1;
+        return b;
+    }
 
-            SL[0] = SL[mem]; SL[1] = SL[mem+1];
-            fread(SL+2, sizeof(short), mem, mergeSL);
-            
-            DA[0] = DA[mem]; DA[1] = DA[mem+1];
-            fread(DA+2, sizeof(char), mem, mergeDA);
-            
-            BWT[0] = BWT[mem]; BWT[1] = BWT[mem+1];
-            fread(BWT+2, sizeof(char), mem, mergeBWT);
-            
-            for(j = 2; j < mem+3; j++) BWT[j] = (BWT[j] == 0) ? '$' : BWT[j];
-            
-            lcpBlockPos = 0;
-            otherBlocksPos = 1;
+    bossBuilderOpen(b, samples);
+    return b;
+}
+
+// Builder of the same k whose BOSS streams go to separated files, appended to the ones of parent by bossBuilderAppend
+static bossBuilder* bossBuilderSegment(bossBuilder *parent, int segment, int samples){
+    bossBuilder *b = calloc(1, sizeof(bossBuilder));
+    b->k = parent->k;
+    snprintf(b->bossLast, FILE_PATH, "%.1000s.%d", parent->bossLast, segment);
+    snprintf(b->bossW, FILE_PATH, "%.1000s.%d", parent->bossW, segment);
+    snprintf(b->bossWm, FILE_PATH, "%.1000s.%d", parent->bossWm, segment);
+    snprintf(b->bossColors, FILE_PATH, "%.1000s.%d", parent->bossColors, segment);
+    snprintf(b->bossCoverage, FILE_PATH, "%.1000s.%d", parent->bossCoverage, segment);
+    snprintf(b->bossSummarizedLCP, FILE_PATH, "%.1000s.%d", parent->bossSummarizedLCP, segment);
+    snprintf(b->bossSummarizedSL, FILE_PATH, "%.1000s.%d", parent->bossSummarizedSL, segment);
+    snprintf(b->bossColorRuns, FILE_PATH, "%.1000s.%d", parent->bossColorRuns, segment);
+    snprintf(b->bossSLFlags, FILE_PATH, "%.1000s.%d", parent->bossSLFlags, segment);
+    snprintf(b->bossLCPFlags, FILE_PATH, "%.1000s.%d", parent->bossLCPFlags, segment);
+    bossBuilderOpen(b, samples);
+    return b;
+}
+
+// Copies fileName to the end of output and removes it. The first value of a summarizedLCP file is lowered to firstLCP
+static void appendFile(FILE *output, char *fileName, short firstLCP){
+    char *buffer = malloc(SEGMENT_SEARCH);
+    size_t bytes;
+    FILE *input = fopen(fileName, "rb");
+    if(input == NULL){
+        fprintf(stderr, "Unable to read file %s\n", fileName);
+        exit(-1);
+    }
+    if(firstLCP < SHRT_MAX){
+        short lcp;
+        if(fread(&lcp, sizeof(short), 1, input) == 1){
+            lcp = MIN(lcp, firstLCP);
+            fwrite(&lcp, sizeof(short), 1, output);
         }
+    }
+    while((bytes = fread(buffer, 1, SEGMENT_SEARCH, input)) > 0)
+        fwrite(buffer, 1, bytes, output);
+    fclose(input);
+    remove(fileName);
+    free(buffer);
+}
 
-        // more than one outgoing edge of vertex i
-        if(LCP[lcpBlockPos+1] >= k && bi != n-1 ){
-            // since there is more than one outgoing edge, we don't need to check if BWT = $ or there is already BWT[bi] in Wi range
-            if(WiFreq[BWT[otherBlocksPos]] == 0){
-                // Add values to BOSS representation
-                addEdge(&W[WiSize], &last, &colors[WiSize], &summarizedLCP[WiSize], &summarizedSL[WiSize], WFreq[BWT[otherBlocksPos]], &Wm[WiSize], BWT[otherBlocksPos], DA[otherBlocksPos], LCP[lcpBlockPos], SL[otherBlocksPos], WiSize, 0);
-                WiFirstOccurrence[DA[otherBlocksPos]][BWT[otherBlocksPos]] = WiSize;
-                // Increment variables
-                C[BWT[otherBlocksPos]]++; WFreq[BWT[otherBlocksPos]]++; WiFreq[BWT[otherBlocksPos]]++; DAFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]]++; WiSize++; i++;
-                (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                (totalSampleColorsInBoss[DA[otherBlocksPos]])++;
-            } else {
-                // check if there is already outgoing edge labeled with BWT[bi] from DA[bi] leaving vertex i
-                if(DAFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]] == 0){
-                    addEdge(&W[WiSize], &last, &colors[WiSize], &summarizedLCP[WiSize], &summarizedSL[WiSize], WFreq[BWT[otherBlocksPos]], &Wm[WiSize], BWT[otherBlocksPos], DA[otherBlocksPos], LCP[lcpBlockPos], SL[otherBlocksPos], WiSize, 0);
-                    WiFirstOccurrence[DA[otherBlocksPos]][BWT[otherBlocksPos]] = WiSize;
-                    C[BWT[otherBlocksPos]]++; WFreq[BWT[otherBlocksPos]]++; WiFreq[BWT[otherBlocksPos]]++; DAFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]]++; WiSize++; i++; 
-                    (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                    (totalSampleColorsInBoss[DA[otherBlocksPos]])++;
-                } else {
-                    // increases the coverage information of the node with outgoing edge labeled with BWT[bi] from DA[bi] which is already on BOSS construction 
-                    int existingPos = WiFirstOccurrence[DA[otherBlocksPos]][BWT[otherBlocksPos]];
-                    coverage[existingPos]++;
-                    (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                }
-            }
+/* Adds the color runs written to fileName, and removes it. A run of the same
+   color as the last one of b continues it, as if the runs were found by b */
+static void appendColorRuns(bossBuilder *b, char *fileName){
+    bossColorRun *runs = malloc(SEGMENT_SEARCH*sizeof(bossColorRun));
+    size_t read, j;
+    FILE *input = fopen(fileName, "rb");
+    if(input == NULL){
+        fprintf(stderr, "Unable to read file %s\n", fileName);
+        exit(-1);
+    }
+    while((read = fread(runs, sizeof(bossColorRun), SEGMENT_SEARCH, input)) > 0){
+        for(j = 0; j < read; j++)
+            addColorRun(b, runs[j].color, runs[j].length);
+    }
+    fclose(input);
+    remove(fileName);
+    free(runs);
+}
+
+/* Adds the flags written by segment and the ones it has not written yet to
+   b, and removes its files. If firstLCP is not larger than k the LCP flag of
+   the first edge is cleared, as its summarizedLCP is lowered to firstLCP */
+static void appendFlags(bossBuilder *b, bossBuilder *segment, short firstLCP){
+    uint64_t *SLFlags = malloc(SEGMENT_SEARCH*sizeof(uint64_t));
+    uint64_t *LCPFlags = malloc(SEGMENT_SEARCH*sizeof(uint64_t));
+    size_t read, j;
+    int first = 1;
+    FILE *SLInput = fopen(segment->bossSLFlags, "rb");
+    FILE *LCPInput = fopen(segment->bossLCPFlags, "rb");
+    if(SLInput == NULL || LCPInput == NULL){
+        fprintf(stderr, "Unable to read file %s\n", segment->bossSLFlags);
+        exit(-1);
+    }
+    while((read = fread(SLFlags, sizeof(uint64_t), SEGMENT_SEARCH, SLInput)) > 0){
+        if(fread(LCPFlags, sizeof(uint64_t), read, LCPInput) != read){
+            fprintf(stderr, "Unable to read file %s\n", segment->bossLCPFlags);
+            exit(-1);
+        }
+        if(first && firstLCP <= b->k) LCPFlags[0] &= ~1ULL;
+        first = 0;
+        for(j = 0; j < read; j++)
+            addFlags(b, SLFlags[j], LCPFlags[j], 64);
+    }
+    if(first && firstLCP <= b->k) segment->LCPFlags &= ~1ULL;
+    addFlags(b, segment->SLFlags, segment->LCPFlags, segment->flagBits);
+    fclose(SLInput);
+    fclose(LCPInput);
+    remove(segment->bossSLFlags);
+    remove(segment->bossLCPFlags);
+    free(SLFlags);
+    free(LCPFlags);
+}
+
+/* Appends the BOSS built by segment, from the merged arrays right after the
+   ones of b, to b. A vertex entirely dropped by the solid k-mer filter at
+   the end of b passes its LCP to the first vertex kept by segment */
+static void bossBuilderAppend(bossBuilder *b, bossBuilder *segment, int samples){
+    int j;
+    fclose(segment->bossLastFile);
+    fclose(segment->bossWFile);
+    fclose(segment->bossWmFile);
+    fclose(segment->bossColorsFile);
+    fclose(segment->bossCoverageFile);
+    fclose(segment->bossSummarizedLCPFile);
+    fclose(segment->bossSummarizedSLFile);
+    fclose(segment->bossColorRunsFile);
+    fclose(segment->bossSLFlagsFile);
+    fclose(segment->bossLCPFlagsFile);
+
+    appendFile(b->bossLastFile, segment->bossLast, SHRT_MAX);
+    appendFile(b->bossWFile, segment->bossW, SHRT_MAX);
+    appendFile(b->bossWmFile, segment->bossWm, SHRT_MAX);
+    appendFile(b->bossColorsFile, segment->bossColors, SHRT_MAX);
+    appendFile(b->bossCoverageFile, segment->bossCoverage, SHRT_MAX);
+    appendFile(b->bossSummarizedLCPFile, segment->bossSummarizedLCP, segment->i > 0 ? b->carryLCP : SHRT_MAX);
+    appendFile(b->bossSummarizedSLFile, segment->bossSummarizedSL, SHRT_MAX);
+    appendColorRuns(b, segment->bossColorRuns);
+    addColorRun(b, segment->colorRun.color, segment->colorRun.length);
+    appendFlags(b, segment, segment->i > 0 ? b->carryLCP : SHRT_MAX);
+
+    b->carryLCP = segment->i > 0 ? segment->carryLCP : MIN(b->carryLCP, segment->carryLCP);
+    b->i += segment->i;
+    b->droppedEdges += segment->droppedEdges;
+    for(j = 0; j < ALPHABET_SIZE; j++) b->C[j] += segment->C[j];
+    for(j = 0; j < samples; j++){
+        b->totalSampleColorsInBoss[j] += segment->totalSampleColorsInBoss[j];
+        b->totalSampleCoverageInBoss[j] += segment->totalSampleCoverageInBoss[j];
+    }
+}
+
+void bossBuilderStep(bossBuilder *b, unsigned char *LCP, unsigned char *SL, short *DA, char *BWT, int lcpBlockPos, int otherBlocksPos, size_t bi, size_t n, int samples, int minAbundance, int printBoss){
+    int j;
+    int k = b->k;
+    char bwt = BWT[otherBlocksPos];
+    short da = DA[otherBlocksPos];
+    int sampleSymbol = SAMPLE_SYMBOL(da, bwt);
+
+    // more than one outgoing edge of vertex i
+    if(LCP[lcpBlockPos+1] >= k && bi != n-1 ){
+        // since there is more than one outgoing edge, we don't need to check if BWT = $ or there is already BWT[bi] in Wi range
+        if(b->WiFreq[bwt] == 0){
+            // Add values to BOSS representation
+            addEdge(&b->W[b->WiSize], &b->last, &b->colors[b->WiSize], &b->summarizedLCP[b->WiSize], &b->summarizedSL[b->WiSize], b->WFreq[bwt], &b->Wm[b->WiSize], bwt, da, LCP[lcpBlockPos], SL[otherBlocksPos], b->WiSize, 0);
+            b->WiFirstOccurrence[sampleSymbol] = b->WiSize;
+            // Increment variables
+            b->C[bwt]++; b->WFreq[bwt]++; b->WiFreq[bwt]++; b->DAFreq[sampleSymbol]++; b->WiSize++; b->i++;
+            (b->totalSampleCoverageInBoss[da])++;
+            (b->totalSampleColorsInBoss[da])++;
         } else {
-            // just one outgoing edge of vertex i
-            if(WiSize == 0){
-                //fix SL[otherBlocksPos-1] memory leak
-                if (SL[otherBlocksPos] == 1 && dummiesFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]] == 0) {
-                    addEdge(&W[WiSize], &last, &colors[WiSize], &summarizedLCP[WiSize], &summarizedSL[WiSize], WFreq[BWT[otherBlocksPos]], &Wm[WiSize], BWT[otherBlocksPos], DA[otherBlocksPos], LCP[lcpBlockPos], SL[otherBlocksPos], WiSize, 1);
-
-                    dummiesFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]]++;
-
-                    C[BWT[otherBlocksPos]]++; WFreq[BWT[otherBlocksPos]]++; i++; WiSize++;
-                    
-                    (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                    (totalSampleColorsInBoss[DA[otherBlocksPos]])++;
-                } else if(SL[otherBlocksPos] > 1 && !(LCP[lcpBlockPos] == SL[otherBlocksPos-1]-1 && BWT[otherBlocksPos] == BWT[otherBlocksPos-1] && DA[otherBlocksPos] == DA[otherBlocksPos-1])){
-                    addEdge(&W[WiSize], &last, &colors[WiSize], &summarizedLCP[WiSize], &summarizedSL[WiSize], WFreq[BWT[otherBlocksPos]], &Wm[WiSize], BWT[otherBlocksPos], DA[otherBlocksPos], LCP[lcpBlockPos], SL[otherBlocksPos], WiSize, 1);
-                    C[BWT[otherBlocksPos]]++; WFreq[BWT[otherBlocksPos]]++; i++; WiSize++;
-                    
-                    (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                    (totalSampleColorsInBoss[DA[otherBlocksPos]])++;
-                } 
-            } 
-            // last outgoing edge of vertex i
-            else {
-                // check if there is already outgoing edge labeled with BWT[bi] leaving vertex i
-                if(WiFreq[BWT[otherBlocksPos]] == 0){
-                    addEdge(&W[WiSize], &last, &colors[WiSize], &summarizedLCP[WiSize], &summarizedSL[WiSize], WFreq[BWT[otherBlocksPos]], &Wm[WiSize], BWT[otherBlocksPos], DA[otherBlocksPos], LCP[lcpBlockPos], SL[otherBlocksPos], WiSize, 2);
-
-                    C[BWT[otherBlocksPos]]++; WFreq[BWT[otherBlocksPos]]++; WiSize++; i++; 
-                    
-                    (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                    (totalSampleColorsInBoss[DA[otherBlocksPos]])++;
-                } else {
-                    // check if there is already outgoing edge labeled with BWT[bi] from DA[bi] leaving vertex i
-                    if(DAFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]] == 0){
-                        addEdge(&W[WiSize], &last, &colors[WiSize], &summarizedLCP[WiSize], &summarizedSL[WiSize], WFreq[BWT[otherBlocksPos]], &Wm[WiSize], BWT[otherBlocksPos], DA[otherBlocksPos], LCP[lcpBlockPos], SL[otherBlocksPos], WiSize, 2);
-
-                        C[BWT[otherBlocksPos]]++; WFreq[BWT[otherBlocksPos]]++; WiFreq[BWT[otherBlocksPos]]++; DAFreq[DA[otherBlocksPos]][BWT[otherBlocksPos]]++; WiSize++; i++;                   
-                        
-                        (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                        (totalSampleColorsInBoss[DA[otherBlocksPos]])++;
-                    } else {
-                        // increases the coverage information of the node with outgoing edge labeled with BWT[bi] from DA[bi] which is already on BOSS construction 
-                        int existingPos = WiFirstOccurrence[DA[otherBlocksPos]][BWT[otherBlocksPos]];
-                        coverage[existingPos]++;
-                        
-                        (totalSampleCoverageInBoss[DA[otherBlocksPos]])++;
-                    }
-                }
-                // sort outgoing edges of vertex i in lexigraphic order 
-                if(WiSize > 1){
-                    WiSort(W, Wm, colors, coverage, summarizedSL, 0, WiSize);
-                    fixWiLCP(W, summarizedLCP, k, WiSize);
-                }                
-
-                // clean frequency variables of outgoing edges in Wi 
-                memset(WiFreq, 0, sizeof(int)*ALPHABET_SIZE);   
-                memset(DAFreq, 0, sizeof(int)*samples*ALPHABET_SIZE);
-                memset(dummiesFreq, 0, sizeof(int)*samples*ALPHABET_SIZE);
-                memset(WiFirstOccurrence, 0, sizeof(int)*samples*ALPHABET_SIZE);
-            }
-            // if next LCP value is smaller than k-1 we have a new (k-1)-mer to keep track, so we clean WFreq values
-            if(LCP[lcpBlockPos+1] < k-1){
-                memset(WFreq, 0, sizeof(int)*ALPHABET_SIZE);
+            // check if there is already outgoing edge labeled with BWT[bi] from DA[bi] leaving vertex i
+            if(b->DAFreq[sampleSymbol] == 0){
+                addEdge(&b->W[b->WiSize], &b->last, &b->colors[b->WiSize], &b->summarizedLCP[b->WiSize], &b->summarizedSL[b->WiSize], b->WFreq[bwt], &b->Wm[b->WiSize], bwt, da, LCP[lcpBlockPos], SL[otherBlocksPos], b->WiSize, 0);
+                b->WiFirstOccurrence[sampleSymbol] = b->WiSize;
+                b->C[bwt]++; b->WFreq[bwt]++; b->WiFreq[bwt]++; b->DAFreq[sampleSymbol]++; b->WiSize++; b->i++; 
+                (b->totalSampleCoverageInBoss[da])++;
+                (b->totalSampleColorsInBoss[da])++;
+            } else {
+                // increases the coverage information of the node with outgoing edge labeled with BWT[bi] from DA[bi] which is already on BOSS construction 
+                int existingPos = b->WiFirstOccurrence[sampleSymbol];
+                b->coverage[existingPos]++;
+                (b->totalSampleCoverageInBoss[da])++;
             }
+        }
+        return;
+    }
+
+    // just one outgoing edge of vertex i
+    if(b->WiSize == 0){
+        //fix SL[otherBlocksPos-1] memory leak
+        if (SL[otherBlocksPos] == 1 && b->dummiesFreq[sampleSymbol] == 0) {
+            addEdge(&b->W[b->WiSize], &b->last, &b->colors[b->WiSize], &b->summarizedLCP[b->WiSize], &b->summarizedSL[b->WiSize], b->WFreq[bwt], &b->Wm[b->WiSize], bwt, da, LCP[lcpBlockPos], SL[otherBlocksPos], b->WiSize, 1);
+
+            b->dummiesFreq[sampleSymbol]++;
 
-            // Write Wi in BOSS results files
-            if(printBoss){
-                fwrite(last, sizeof(short), WiSize, bossLastFile);
-                fwrite(W, sizeof(char), WiSize, bossWFile);
-                fwrite(Wm, sizeof(short), WiSize, bossWm_file);
+            b->C[bwt]++; b->WFreq[bwt]++; b->i++; b->WiSize++;
+            
+            (b->totalSampleCoverageInBoss[da])++;
+            (b->totalSampleColorsInBoss[da])++;
+        } else if(SL[otherBlocksPos] > 1 && !(SL[otherBlocksPos] == SL[otherBlocksPos-1] && LCP[lcpBlockPos] == SL[otherBlocksPos-1]-1 && bwt == BWT[otherBlocksPos-1] && da == DA[otherBlocksPos-1])){
+            // only the same $-padded vertex from another string of the same genome is skipped, a previous string that is a prefix of this one is another vertex
+            addEdge(&b->W[b->WiSize], &b->last, &b->colors[b->WiSize], &b->summarizedLCP[b->WiSize], &b->summarizedSL[b->WiSize], b->WFreq[bwt], &b->Wm[b->WiSize], bwt, da, LCP[lcpBlockPos], SL[otherBlocksPos], b->WiSize, 1);
+            b->C[bwt]++; b->WFreq[bwt]++; b->i++; b->WiSize++;
+            
+            (b->totalSampleCoverageInBoss[da])++;
+            (b->totalSampleColorsInBoss[da])++;
+        } 
+    } 
+    // last outgoing edge of vertex i
+    else {
+        // check if there is already outgoing edge labeled with BWT[bi] leaving vertex i
+        if(b->WiFreq[bwt] == 0){
+            addEdge(&b->W[b->WiSize], &b->last, &b->colors[b->WiSize], &b->summarizedLCP[b->WiSize], &b->summarizedSL[b->WiSize], b->WFreq[bwt], &b->Wm[b->WiSize], bwt, da, LCP[lcpBlockPos], SL[otherBlocksPos], b->WiSize, 2);
+
+            b->C[bwt]++; b->WFreq[bwt]++; b->WiSize++; b->i++; 
+            
+            (b->totalSampleCoverageInBoss[da])++;
+            (b->totalSampleColorsInBoss[da])++;
+        } else {
+            // check if there is already outgoing edge labeled with BWT[bi] from DA[bi] leaving vertex i
+            if(b->DAFreq[sampleSymbol] == 0){
+                addEdge(&b->W[b->WiSize], &b->last, &b->colors[b->WiSize], &b->summarizedLCP[b->WiSize], &b->summarizedSL[b->WiSize], b->WFreq[bwt], &b->Wm[b->WiSize], bwt, da, LCP[lcpBlockPos], SL[otherBlocksPos], b->WiSize, 2);
+
+                b->C[bwt]++; b->WFreq[bwt]++; b->WiFreq[bwt]++; b->DAFreq[sampleSymbol]++; b->WiSize++; b->i++;                   
+                
+                (b->totalSampleCoverageInBoss[da])++;
+                (b->totalSampleColorsInBoss[da])++;
+            } else {
+                // increases the coverage information of the node with outgoing edge labeled with BWT[bi] from DA[bi] which is already on BOSS construction 
+                int existingPos = b->WiFirstOccurrence[sampleSymbol];
+                b->coverage[existingPos]++;
+                
+                (b->totalSampleCoverageInBoss[da])++;
             }
+        }
+        // sort outgoing edges of vertex i in lexigraphic order 
+        if(b->WiSize > 1){
+            WiSort(b->W, b->Wm, b->colors, b->coverage, b->summarizedSL, 0, b->WiSize);
+            fixWiLCP(b->W, b->summarizedLCP, k, b->WiSize);
+        }                
+
+        // clean frequency variables of outgoing edges in Wi 
+        memset(b->WiFreq, 0, sizeof(int)*ALPHABET_SIZE);   
+        memset(b->DAFreq, 0, sizeof(int)*samples*ALPHABET_SIZE);
+        memset(b->dummiesFreq, 0, sizeof(int)*samples*ALPHABET_SIZE);
+        memset(b->WiFirstOccurrence, 0, sizeof(int)*samples*ALPHABET_SIZE);
+    }
 
-            // needed for bwsd computation
-            fwrite(colors, sizeof(short), WiSize, bossColorsFile);
-            fwrite(coverage, sizeof(int), WiSize, bossCoverageFile);
-            fwrite(summarizedLCP, sizeof(short), WiSize, bossSummarizedLCPFile);
-            fwrite(summarizedSL, sizeof(short), WiSize, bossSummarizedSLFile);
+    int WiUsed = b->WiSize;
 
-            // clean buffers
-            memset(last, 0, sizeof(short)*200);   
-            memset(W, 0, sizeof(char)*200);   
-            memset(Wm, 0, sizeof(short)*200);   
-            memset(colors, 0, sizeof(short)*200);   
-            memset(coverage, 0, sizeof(int)*200);   
-            memset(summarizedLCP, 0, sizeof(short)*200);   
-            memset(summarizedSL, 0, sizeof(short)*200);   
+    // drop edges whose coverage in their genome is below the solid k-mer threshold
+    if(minAbundance > 1 && b->WiSize > 0){
+        int kept = solidFilter(b->W, b->last, b->Wm, b->colors, b->coverage, b->summarizedLCP, b->summarizedSL, b->WiSize, k, minAbundance, b->solidWFreq, &b->carryLCP, b->C, b->totalSampleColorsInBoss, b->totalSampleCoverageInBoss);
+        b->droppedEdges += b->WiSize-kept;
+        b->i -= b->WiSize-kept;
+        b->WiSize = kept;
+    }
 
-            for(j = 0; j < 200; j++) coverage[j] = 1;
+    // if next LCP value is smaller than k-1 we have a new (k-1)-mer to keep track, so we clean WFreq values
+    if(LCP[lcpBlockPos+1] < k-1){
+        memset(b->WFreq, 0, sizeof(int)*ALPHABET_SIZE);
+        memset(b->solidWFreq, 0, sizeof(int)*ALPHABET_SIZE);
+    }
 
-            WiSize = 0; 
-        }
-        lcpBlockPos++;
-        otherBlocksPos++;
-        bi++;
+    // Write Wi in BOSS results files
+    fwrite(b->last, sizeof(short), b->WiSize, b->bossLastFile);
+    fwrite(b->W, sizeof(char), b->WiSize, b->bossWFile);
+    fwrite(b->Wm, sizeof(short), b->WiSize, b->bossWmFile);
+
+    // needed for bwsd computation
+    fwrite(b->colors, sizeof(short), b->WiSize, b->bossColorsFile);
+    size_t coverageBytes = 0;
+    for(j = 0; j < b->WiSize; j++)
+        coverageBytes += bossCoverageEncode(b->coverageBytes+coverageBytes, b->coverage[j]);
+    fwrite(b->coverageBytes, sizeof(char), coverageBytes, b->bossCoverageFile);
+    fwrite(b->summarizedLCP, sizeof(short), b->WiSize, b->bossSummarizedLCPFile);
+    fwrite(b->summarizedSL, sizeof(short), b->WiSize, b->bossSummarizedSLFile);
+    for(j = 0; j < b->WiSize; j++){
+        if(b->summarizedSL[j] > k)
+            addColorRun(b, b->colors[j], 1);
+        addFlags(b, b->summarizedSL[j] > k, b->summarizedLCP[j] > k, 1);
     }
 
+    // clean buffers, entries after WiUsed were never written
+    memset(b->last, 0, sizeof(short)*WiUsed);   
+    memset(b->W, 0, sizeof(char)*WiUsed);   
+    memset(b->Wm, 0, sizeof(short)*WiUsed);   
+    memset(b->colors, 0, sizeof(short)*WiUsed);   
+    memset(b->summarizedLCP, 0, sizeof(short)*WiUsed);   
+    memset(b->summarizedSL, 0, sizeof(short)*WiUsed);   
+
+    for(j = 0; j < WiUsed; j++) b->coverage[j] = 1;
+
+    b->WiSize = 0; 
+}
+
+void bossBuilderFinish(bossBuilder *b, int samples, char* file1, char* file2, int printBoss, int minAbundance, phaseMetrics *construction){
+    int j;
+    int k = b->k;
+    unsigned long *C = b->C;
+
     // fix C values
     C[1] = C['$'];
     C[2] = C['A'] + C[1];
@@ -333,94 +589,331 @@ void bossConstruction(FILE *mergeLCP, FILE *mergeDA, FILE *mergeBWT, FILE *merge
     C[5] = C['N'] + C[4];
     C[0] = 0;
 
-    #if ALL_VS_ALL
-    FILE *bossInfoFile = getBossInfoFile(file1, NULL, k, 1);
-    #else
-    FILE *bossInfoFile = getBossInfoFile(file1, file2, k, 1);
-    #endif
+    FILE *infoFile = getInfoFile(file1, file2, k, 0);
 
-    fprintf(bossInfoFile, "%ld\n", i);
-    for(j = 0; j < samples; j++){
-        fprintf(bossInfoFile, "%ld ", totalSampleColorsInBoss[j]);
-        // free(totalSampleColorsInBoss[j]);
+    if(runMode.debug){
+        char alphabet[6] = {'$', 'A', 'C', 'G', 'N', 'T'};
+        printBOSSDebug(b->i, infoFile, file1, file2, alphabet, C, b->totalSampleCoverageInBoss, samples);
     }
-    free(totalSampleColorsInBoss);
-    fprintf(bossInfoFile, "\n");
-    for(j = 0; j < samples; j++){
-        fprintf(bossInfoFile, "%ld ", totalSampleCoverageInBoss[j]);
-        // free(totalSampleCoverageInBossm[j]);
+
+    if(minAbundance > 1){
+        printf("Solid k-mer filter dropped %ld edges with coverage below %d (k = %d)\n", b->droppedEdges, minAbundance, k);
+        fprintf(infoFile, "Solid k-mer filter dropped %ld edges with coverage below %d\n", b->droppedEdges, minAbundance);
     }
-    free(totalSampleCoverageInBoss);
-    fprintf(bossInfoFile, "\n");
-    fclose(bossInfoFile);
 
-    #if ALL_VS_ALL
-    FILE *infoFile = getInfoFile(file1, NULL, k, 0);
-    #else
-    FILE *infoFile = getInfoFile(file1, file2, k, 0);
-    #endif
+    metricsPrint(infoFile, construction);
+
+    fclose(b->bossLastFile);
+    fclose(b->bossWFile);
+    fclose(b->bossWmFile);
+    fclose(b->bossColorsFile);
+    fclose(b->bossCoverageFile);
+    fclose(b->bossSummarizedLCPFile);
+    fclose(b->bossSummarizedSLFile);
+    if(b->colorRun.length > 0)
+        fwrite(&b->colorRun, sizeof(bossColorRun), 1, b->bossColorRunsFile);
+    fclose(b->bossColorRunsFile);
+    if(b->flagBits > 0){
+        fwrite(&b->SLFlags, sizeof(uint64_t), 1, b->bossSLFlagsFile);
+        fwrite(&b->LCPFlags, sizeof(uint64_t), 1, b->bossLCPFlagsFile);
+    }
+    fclose(b->bossSLFlagsFile);
+    fclose(b->bossLCPFlagsFile);
+
+    // pack the BOSS streams into a single file, the loose ones are only kept if asked to print them
+    char *sectionFiles[BOSS_SECTIONS];
+    sectionFiles[BOSS_LAST] = b->bossLast;
+    sectionFiles[BOSS_W] = b->bossW;
+    sectionFiles[BOSS_WM] = b->bossWm;
+    sectionFiles[BOSS_COLORS] = b->bossColors;
+    sectionFiles[BOSS_COVERAGE] = b->bossCoverage;
+    sectionFiles[BOSS_SUMMARIZED_LCP] = b->bossSummarizedLCP;
+    sectionFiles[BOSS_SUMMARIZED_SL] = b->bossSummarizedSL;
+    sectionFiles[BOSS_COLOR_RUNS] = b->bossColorRuns;
+    sectionFiles[BOSS_SL_FLAGS] = b->bossSLFlags;
+    sectionFiles[BOSS_LCP_FLAGS] = b->bossLCPFlags;
+
+    phaseMetrics packing;
+    metricsStart(&packing, "BOSS file writing");
+    packing.k = k;
+    char partName[FILE_PATH+5];
+    snprintf(partName, FILE_PATH+5, "%s.part", b->bossFileName);
+    if(bossFileWrite(partName, sectionFiles, b->i, k, samples, minAbundance, C, b->totalSampleColorsInBoss, b->totalSampleCoverageInBoss) != 0 || manifestCommit(partName, b->bossFileName, b->key) != 0){
+        fprintf(stderr, "Error writing BOSS file %s\n", b->bossFileName);
+        exit(-1);
+    }
+    metricsStop(&packing);
+    metricsPrint(infoFile, &packing);
+    fclose(infoFile);
 
-    #if DEBUG
-    char alphabet[6] = {'$', 'A', 'C', 'G', 'N', 'T'};
-        #if ALL_VS_ALL
-        printBOSSDebug(i, infoFile, file1, NULL, alphabet, C, totalSampleCoverageInBoss, samples);
-        #else
-        printBOSSDebug(i, infoFile, file1, file2, alphabet, C, totalSampleCoverageInBoss, samples);
-        #endif
-    #endif
+    if(!printBoss){
+        for(j = 0; j < BOSS_SECTIONS; j++)
+            remove(sectionFiles[j]);
+    }
+}
+
+void bossBuilderFree(bossBuilder *b){
+    if(!b->skip){
+        free(b->last); free(b->W); free(b->Wm); free(b->colors); free(b->coverage); free(b->coverageBytes); free(b->summarizedLCP); free(b->summarizedSL);
+        free(b->WiFirstOccurrence); free(b->DAFreq); free(b->dummiesFreq);
+        free(b->totalSampleColorsInBoss); free(b->totalSampleCoverageInBoss);
+    }
+    free(b);
+}
 
-    end = clock();
+// Reads count genome ids of the merged DA, through buffer if they have 1 byte
+static size_t readDA(short *DA, size_t count, chunkReader *mergeDA, unsigned char *buffer){
+    if(buffer == NULL)
+        return chunkReaderRead(DA, sizeof(short), count, mergeDA);
+    size_t read = chunkReaderRead(buffer, sizeof(char), count, mergeDA);
+    for(size_t j = 0; j < read; j++) DA[j] = buffer[j];
+    return read;
+}
 
-    cpuTimeUsed = ((double) (end - start)) / CLOCKS_PER_SEC;
+/* Scans positions [start, end) of the merged arrays. The SL, DA and BWT
+   blocks also hold the position before the one being processed */
+typedef struct {
+    bossBuilder **builders; // NULL for the k values already computed
+    int kCount;
+    char *mergeLCPFile, *mergeDAFile, *mergeBWTFile, *mergeSLFile;
+    int daBytes;
+    size_t start, end, n;
+    int samples, mem, minAbundance, printBoss;
+} bossSegment;
+
+static void* bossSegmentRun(void *arg){
+    bossSegment *s = (bossSegment*)arg;
+    int j, x;
+    int mem = s->mem;
+    size_t bi = s->start; // iterates through BWT, LCP, SL and DA 
+    int lcpBlockPos = 0; // iterates through LCP memory blocks
+    int otherBlocksPos = 1; // iterates through BWT, SL and DA memory blocks
 
-    printf("BOSS construction time: %lf seconds\n", cpuTimeUsed);
+    // a segment after the first one also reads the position before it
+    int previous = s->start > 0 ? 1 : 0;
+    chunkReader *mergeLCP = chunkReaderOpen(s->mergeLCPFile, s->start);
+    chunkReader *mergeDA = chunkReaderOpen(s->mergeDAFile, (s->start-previous)*s->daBytes);
+    chunkReader *mergeBWT = chunkReaderOpen(s->mergeBWTFile, s->start-previous);
+    chunkReader *mergeSL = chunkReaderOpen(s->mergeSLFile, s->start-previous);
+    if(mergeLCP == NULL || mergeDA == NULL || mergeBWT == NULL || mergeSL == NULL){
+        fprintf(stderr, "Unable to read merge files %s\n", s->mergeBWTFile);
+        exit(-1);
+    }
 
-    fprintf(infoFile, "BOSS construction time: %lf seconds\n", cpuTimeUsed);
-    fclose(infoFile);
+    // LCP, SL, DA and BWT blocks needed for BOSS construction
+    unsigned char *LCP = (unsigned char*)calloc((mem+2), sizeof(unsigned char));
+    unsigned char *SL = (unsigned char*)calloc((mem+3), sizeof(unsigned char));
+    short *DA = (short*)calloc((mem+3), sizeof(short));
+    unsigned char *DABytes = s->daBytes == 1 ? (unsigned char*)malloc(mem+2) : NULL;
+    char *BWT = (char*)calloc((mem+3), sizeof(char));
 
-    // free BOSS construction needed variables
-    free(LCP); free(BWT); free(DA); free(SL);
-    
-    // free BOSS construction variables
-    free(last); free(W); free(Wm); free(colors); free(coverage); free(summarizedLCP); free(summarizedSL);
-    
-    if(printBoss){
-        fclose(bossLastFile);
-        fclose(bossWFile);
-        fclose(bossWm_file);
-    } else {
-        fclose(bossLastFile);
-        fclose(bossWFile);
-        fclose(bossWm_file);
-        remove(bossLast);
-        remove(bossW);
-        remove(bossWm);
+    chunkReaderRead(LCP, sizeof(unsigned char), mem+1, mergeLCP);
+    chunkReaderRead(SL+1-previous, sizeof(unsigned char), mem+1+previous, mergeSL);
+    readDA(DA+1-previous, mem+1+previous, mergeDA, DABytes);
+    chunkReaderRead(BWT+1-previous, sizeof(char), mem+1+previous, mergeBWT);
+    for(j = 1-previous; j < mem+3; j++) BWT[j] = (BWT[j] == 0) ? '$' : BWT[j];
+
+    while(bi < s->end){
+
+        // read next block
+        if(bi != s->start && lcpBlockPos%mem == 0){
+            LCP[0] = LCP[mem];
+            chunkReaderRead(LCP+1, sizeof(unsigned char), mem, mergeLCP);
+
+            SL[0] = SL[mem]; SL[1] = SL[mem+1];
+            chunkReaderRead(SL+2, sizeof(unsigned char), mem, mergeSL);
+            
+            DA[0] = DA[mem]; DA[1] = DA[mem+1];
+            readDA(DA+2, mem, mergeDA, DABytes);
+            
+            BWT[0] = BWT[mem]; BWT[1] = BWT[mem+1];
+            chunkReaderRead(BWT+2, sizeof(char), mem, mergeBWT);
+            
+            for(j = 2; j < mem+3; j++) BWT[j] = (BWT[j] == 0) ? '$' : BWT[j];
+            
+            lcpBlockPos = 0;
+            otherBlocksPos = 1;
+        }
+
+        for(x = 0; x < s->kCount; x++){
+            if(s->builders[x] != NULL)
+                bossBuilderStep(s->builders[x], LCP, SL, DA, BWT, lcpBlockPos, otherBlocksPos, bi, s->n, s->samples, s->minAbundance, s->printBoss);
+        }
+
+        lcpBlockPos++;
+        otherBlocksPos++;
+        bi++;
     }
 
-    fclose(bossColorsFile);
-    fclose(bossCoverageFile);
-    fclose(bossSummarizedLCPFile);
-    fclose(bossSummarizedSLFile);
+    chunkReaderClose(mergeLCP);
+    chunkReaderClose(mergeDA);
+    chunkReaderClose(mergeBWT);
+    chunkReaderClose(mergeSL);
+    free(LCP); free(BWT); free(DA); free(SL); free(DABytes);
+    return NULL;
+}
+
+/* Splits the merged arrays in up to threads segments of about the same size,
+   writing their limits to bounds[0..segments]. A segment starts where the
+   LCP is smaller than minK-1, so no vertex or (k-1)-mer of any k spans two
+   segments, and after a suffix longer than $ (the $ suffixes come first and
+   share the dummy edges of each genome) */
+static int bossSegments(char *mergeLCPFile, char *mergeSLFile, size_t n, int minK, int threads, size_t *bounds){
+    int t, j, segments = 0;
+    bounds[0] = 0;
+
+    if(threads > 1 && minK > 1){
+        unsigned char *LCP = malloc(SEGMENT_SEARCH);
+        unsigned char *SL = malloc(SEGMENT_SEARCH+1);
+        for(t = 1; t < threads; t++){
+            size_t position = MAX(n/threads*t, bounds[segments]+1);
+            size_t found = 0;
+            chunkReader *mergeLCP = chunkReaderOpen(mergeLCPFile, position);
+            chunkReader *mergeSL = chunkReaderOpen(mergeSLFile, position-1);
+            if(mergeLCP == NULL || mergeSL == NULL){
+                fprintf(stderr, "Unable to read merge files %s\n", mergeLCPFile);
+                exit(-1);
+            }
+            // SL[j] is the one before LCP[j], the last one of a block is kept for the next block
+            if(chunkReaderRead(SL, sizeof(unsigned char), 1, mergeSL) != 1){
+                fprintf(stderr, "Unable to read merge file %s at position %ld\n", mergeSLFile, position-1);
+                exit(-1);
+            }
+            while(position < n && found == 0){
+                // both arrays have n values, a short read of either one would put them out of step
+                size_t read = MIN(SEGMENT_SEARCH, n-position);
+                if(chunkReaderRead(LCP, sizeof(unsigned char), read, mergeLCP) != read || chunkReaderRead(SL+1, sizeof(unsigned char), read, mergeSL) != read){
+                    fprintf(stderr, "Unable to read merge files %s and %s at position %ld\n", mergeLCPFile, mergeSLFile, position);
+                    exit(-1);
+                }
+                for(j = 0; j < (int)read && found == 0; j++){
+                    if(LCP[j] < minK-1 && SL[j] > 1)
+                        found = position+j;
+                }
+                position += read;
+                SL[0] = SL[read];
+            }
+            chunkReaderClose(mergeLCP);
+            chunkReaderClose(mergeSL);
+            if(found == 0)
+                break;
+            bounds[++segments] = found;
+        }
+        free(LCP);
+        free(SL);
+    }
+
+    bounds[++segments] = n;
+    return segments;
+}
+
+void bossConstruction(char *mergeLCPFile, char *mergeDAFile, char *mergeBWTFile, char *mergeSLFile, size_t n, int *k, int kCount, int samples, int mem, char* file1, char* file2, int printBoss, int minAbundance, uint64_t mergeKey, int daBytes, int threads){
+    int x, t;
+
+    // Count computation time, wall and CPU, of the scan shared by every k
+    phaseMetrics construction;
+    metricsStart(&construction, "BOSS construction");
+
+    // one BOSS per k value, all of them built from the same scan of the merged arrays
+    bossBuilder **builders = malloc(kCount*sizeof(bossBuilder*));
+    int pending = 0, minK = INT_MAX;
+    for(x = 0; x < kCount; x++){
+        builders[x] = bossBuilderCreate(k[x], samples, file1, file2, mergeKey, minAbundance);
+        if(!builders[x]->skip){
+            pending++;
+            minK = MIN(minK, k[x]);
+        }
+    }
+    if(pending == 0){
+        for(x = 0; x < kCount; x++) bossBuilderFree(builders[x]);
+        free(builders);
+        metricsStop(&construction);
+        return;
+    }
+
+    // each segment of the merged arrays is scanned by its own thread, the first one with the builders of every k
+    size_t *bounds = malloc((MAX(threads, 1)+1)*sizeof(size_t));
+    int segments = bossSegments(mergeLCPFile, mergeSLFile, n, minK, threads, bounds);
+    bossSegment *scans = malloc(segments*sizeof(bossSegment));
+    pthread_t *ids = malloc(segments*sizeof(pthread_t));
+    for(t = 0; t < segments; t++){
+        bossSegment *s = &scans[t];
+        s->builders = malloc(kCount*sizeof(bossBuilder*));
+        for(x = 0; x < kCount; x++){
+            if(builders[x]->skip)
+                s->builders[x] = NULL;
+            else
+                s->builders[x] = t == 0 ? builders[x] : bossBuilderSegment(builders[x], t, samples);
+        }
+        s->kCount = kCount;
+        s->mergeLCPFile = mergeLCPFile;
+        s->mergeDAFile = mergeDAFile;
+        s->mergeBWTFile = mergeBWTFile;
+        s->mergeSLFile = mergeSLFile;
+        s->daBytes = daBytes;
+        s->start = bounds[t];
+        s->end = bounds[t+1];
+        s->n = n;
+        s->samples = samples;
+        s->mem = mem;
+        s->minAbundance = minAbundance;
+        s->printBoss = printBoss;
+        if(segments == 1)
+            bossSegmentRun(s);
+        else
+            pthread_create(&ids[t], NULL, bossSegmentRun, s);
+    }
+    for(t = 0; t < segments && segments > 1; t++)
+        pthread_join(ids[t], NULL);
+
+    // the BOSS of each segment follows the one of the segment before it
+    for(t = 1; t < segments; t++){
+        for(x = 0; x < kCount; x++){
+            if(scans[t].builders[x] != NULL){
+                bossBuilderAppend(builders[x], scans[t].builders[x], samples);
+                bossBuilderFree(scans[t].builders[x]);
+            }
+        }
+    }
+    for(t = 0; t < segments; t++) free(scans[t].builders);
+    free(scans);
+    free(ids);
+    free(bounds);
+
+    metricsStop(&construction);
+
+    if(pending > 1)
+        printf("BOSS construction time (%d k values): %lf seconds\n", pending, construction.wallTime);
+    else
+        printf("BOSS construction time: %lf seconds\n", construction.wallTime);
+    if(segments > 1)
+        printf("BOSS constructed in %d segments\n", segments);
+
+    for(x = 0; x < kCount; x++){
+        if(!builders[x]->skip)
+            bossBuilderFinish(builders[x], samples, file1, file2, printBoss, minAbundance, &construction);
+        bossBuilderFree(builders[x]);
+    }
+    free(builders);
 
     return;
 };
 
-void printBOSSDebug(unsigned long bossLength, FILE* infoFile, char* file1, char* file2, char* alphabet, int* C, size_t* totalSampleCoverageInBoss, int samples){
+void printBOSSDebug(unsigned long bossLength, FILE* infoFile, char* file1, char* file2, char* alphabet, unsigned long* C, size_t* totalSampleCoverageInBoss, int samples){
     size_t j;
-    #if ALL_VS_ALL
+    if(runMode.allVsAll)
         fprintf(infoFile, "BOSS construction info of genomes from %s merge:\n\n", file1);
-    #else
+    else
         fprintf(infoFile, "BOSS construction info of %s and %s genomes merge:\n\n", file1, file2);   
-    #endif
 
     fprintf(infoFile, "C array:\n");
     for(j = 0; j < 6; j++)
-        fprintf(infoFile, "%c %d\n", alphabet[j], C[j]);
+        fprintf(infoFile, "%c %ld\n", alphabet[j], C[j]);
     fprintf(infoFile, "\n");
 
     fprintf(infoFile, "Frequencies:\n");
     for(j = 0; j < 6; j++)
-        fprintf(infoFile, "%c %d\n", alphabet[j], C[alphabet[j]]);
+        fprintf(infoFile, "%c %ld\n", alphabet[j], C[(int)alphabet[j]]);
     fprintf(infoFile, "\n");
 
     fprintf(infoFile, "BOSS length: %ld\n\n", bossLength);
@@ -1,13 +1,42 @@
+#include "metrics.h"
+
 void WiSort(char *Wi, short *Wm, short *colors, int *coverage, short *summarizedSL, int start, int end);
 
 void fixWiLCP(char *W, short *summarizedLCP, int k, int WiSize);
 
-void bossConstruction(FILE *mergeLCP, FILE *mergeDA, FILE *mergeBWT, FILE *mergeSL, size_t n, int k, int samples, int mem, char* file1, char* file2, int printBoss);
+/* Builds the BOSS of every k in k[0..kCount-1] from a single scan of the
+   merged arrays, whose manifest key is mergeKey. A BOSS file already in the
+   manifest with the same key is kept. Genome ids of mergeDA have daBytes
+   bytes (1 or 2). The arrays are split in up to threads segments, at
+   (k-1)-mer boundaries, built in parallel and concatenated. mergeLCP and
+   mergeSL have 1 byte values, capped above every k
+ */
+void bossConstruction(char *mergeLCPFile, char *mergeDAFile, char *mergeBWTFile, char *mergeSLFile, size_t n, int *k, int kCount, int samples, int mem, char* file1, char* file2, int printBoss, int minAbundance, uint64_t mergeKey, int daBytes, int threads);
+
+// Manifest key of the BOSS file of k built from the merge with key mergeKey
+uint64_t bossKey(uint64_t mergeKey, int k, int samples, int minAbundance);
+
+// BOSS construction state of a single k
+typedef struct bossBuilder bossBuilder;
+
+bossBuilder* bossBuilderCreate(int k, int samples, char* file1, char* file2, uint64_t mergeKey, int minAbundance);
+
+// Processes position bi of the merged arrays
+void bossBuilderStep(bossBuilder *b, unsigned char *LCP, unsigned char *SL, short *DA, char *BWT, int lcpBlockPos, int otherBlocksPos, size_t bi, size_t n, int samples, int minAbundance, int printBoss);
+
+void bossBuilderFinish(bossBuilder *b, int samples, char* file1, char* file2, int printBoss, int minAbundance, phaseMetrics *construction);
+
+void bossBuilderFree(bossBuilder *b);
+
+void printBOSSDebug(unsigned long bossLength, FILE* infoFile, char* file1, char* file2, char* alphabet, unsigned long* C, size_t* totalSampleCoverageInBoss, int samples);
+
+// Removes edges with coverage smaller than minAbundance from Wi, returns the new WiSize
+int solidFilter(char *W, short *last, short *Wm, short *colors, int *coverage, short *summarizedLCP, short *summarizedSL, int WiSize, int k, int minAbundance, int *solidWFreq, short *carryLCP, unsigned long *C, size_t *totalSampleColorsInBoss, size_t *totalSampleCoverageInBoss);
 
 /* edgeStatus:
    0: any outgoing edge besides the last one
    1: just one outgoing edge
    2: last outgoing edge from a set
  */
-void addEdge(char *W, short **last, short *colors, short *summarizedLCP, short *summarizedSL, int freq, short *Wm, char bwt, char da, short lcp, short sl, int WiSize, int edgeStatus);
+void addEdge(char *W, short **last, short *colors, short *summarizedLCP, short *summarizedSL, int freq, short *Wm, char bwt, short da, short lcp, short sl, int WiSize, int edgeStatus);
 
@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "bossfile.h"
+
+#define COPY_BUFFER (1 << 20)
+
+#define FNV_PRIME 1099511628211ULL
+
+static const uint32_t sectionWidths[BOSS_SECTIONS] = {
+    sizeof(short), // last
+    sizeof(char), // W
+    sizeof(short), // Wm
+    sizeof(short), // colors
+    sizeof(char), // coverage varints
+    sizeof(short), // summarizedLCP
+    sizeof(short), // summarizedSL
+    sizeof(bossColorRun), // color runs
+    sizeof(uint64_t), // summarizedSL > k
+    sizeof(uint64_t), // summarizedLCP > k
+};
+
+// FNV-1a, checksum must start as BOSS_CHECKSUM_START
+uint64_t bossChecksum(uint64_t checksum, const void *data, size_t len){
+    const unsigned char *bytes = (const unsigned char*)data;
+    for(size_t i = 0; i < len; i++){
+        checksum ^= bytes[i];
+        checksum *= FNV_PRIME;
+    }
+    return checksum;
+}
+
+static uint64_t alignOffset(uint64_t offset){
+    return ((offset + BOSS_FILE_ALIGNMENT - 1)/BOSS_FILE_ALIGNMENT)*BOSS_FILE_ALIGNMENT;
+}
+
+static size_t headerSize(int samples){
+    return sizeof(bossFileHeader) + 2*samples*sizeof(uint64_t) + BOSS_SECTIONS*sizeof(bossSectionEntry);
+}
+
+int bossFileWrite(char *fileName, char **sectionFiles, uint64_t n, int k, int samples, int minAbundance, unsigned long *C, size_t *totalSampleColorsInBoss, size_t *totalSampleCoverageInBoss){
+    int i;
+    size_t size = headerSize(samples);
+    char *header = calloc(size, 1);
+
+    bossFileHeader *h = (bossFileHeader*)header;
+    uint64_t *colorsTotals = (uint64_t*)(header + sizeof(bossFileHeader));
+    uint64_t *coverageTotals = colorsTotals + samples;
+    bossSectionEntry *sections = (bossSectionEntry*)(coverageTotals + samples);
+
+    memcpy(h->magic, BOSS_FILE_MAGIC, sizeof(h->magic));
+    h->version = BOSS_FILE_VERSION;
+    h->headerSize = alignOffset(size);
+    h->n = n;
+    h->k = k;
+    h->samples = samples;
+    h->minAbundance = minAbundance;
+    h->sectionCount = BOSS_SECTIONS;
+    for(i = 0; i < 6; i++) h->C[i] = C[i];
+    for(i = 0; i < samples; i++){
+        colorsTotals[i] = totalSampleColorsInBoss[i];
+        coverageTotals[i] = totalSampleCoverageInBoss[i];
+    }
+
+    FILE *bossFile = fopen(fileName, "wb");
+    if(bossFile == NULL){
+        free(header);
+        return -1;
+    }
+
+    char *buffer = malloc(COPY_BUFFER);
+    uint64_t offset = h->headerSize;
+
+    // copy sections after the header, which is written last with their offsets and checksums
+    for(i = 0; i < BOSS_SECTIONS; i++){
+        FILE *section = fopen(sectionFiles[i], "rb");
+        if(section == NULL){
+            fclose(bossFile); free(buffer); free(header);
+            return -1;
+        }
+        fseek(bossFile, offset, SEEK_SET);
+        sections[i].offset = offset;
+        sections[i].width = sectionWidths[i];
+        sections[i].length = 0;
+        sections[i].checksum = BOSS_CHECKSUM_START;
+
+        size_t read;
+        while((read = fread(buffer, 1, COPY_BUFFER, section)) > 0){
+            fwrite(buffer, 1, read, bossFile);
+            sections[i].checksum = bossChecksum(sections[i].checksum, buffer, read);
+            sections[i].length += read;
+        }
+        fclose(section);
+        offset = alignOffset(offset + sections[i].length);
+    }
+
+    h->checksum = 0;
+    h->checksum = bossChecksum(BOSS_CHECKSUM_START, header, size);
+
+    rewind(bossFile);
+    fwrite(header, 1, size, bossFile);
+    int error = ferror(bossFile);
+    fclose(bossFile);
+
+    free(buffer);
+    free(header);
+
+    return error ? -1 : 0;
+}
+
+bossFile* bossFileOpen(char *fileName, int verify){
+    int i;
+    int fd = open(fileName, O_RDONLY);
+    if(fd == -1)
+        return NULL;
+
+    struct stat st;
+    if(fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(bossFileHeader)){
+        close(fd);
+        return NULL;
+    }
+
+    char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(data == MAP_FAILED)
+        return NULL;
+
+    bossFile *boss = calloc(1, sizeof(bossFile));
+    boss->data = data;
+    boss->size = st.st_size;
+    boss->header = (bossFileHeader*)data;
+
+    bossFileHeader *h = boss->header;
+    if(memcmp(h->magic, BOSS_FILE_MAGIC, sizeof(h->magic)) != 0 || h->version != BOSS_FILE_VERSION || h->sectionCount != BOSS_SECTIONS || headerSize(h->samples) > boss->size){
+        fprintf(stderr, "%s is not a version %d BOSS file\n", fileName, BOSS_FILE_VERSION);
+        bossFileClose(boss);
+        return NULL;
+    }
+
+    boss->totalSampleColorsInBoss = (uint64_t*)(data + sizeof(bossFileHeader));
+    boss->totalSampleCoverageInBoss = boss->totalSampleColorsInBoss + h->samples;
+    boss->sections = (bossSectionEntry*)(boss->totalSampleCoverageInBoss + h->samples);
+
+    // header checksum is computed with the checksum field zeroed
+    size_t size = headerSize(h->samples);
+    char *header = malloc(size);
+    memcpy(header, data, size);
+    ((bossFileHeader*)header)->checksum = 0;
+    uint64_t checksum = bossChecksum(BOSS_CHECKSUM_START, header, size);
+    free(header);
+
+    int valid = checksum == h->checksum;
+    for(i = 0; i < BOSS_SECTIONS && valid; i++){
+        bossSectionEntry *section = &boss->sections[i];
+        uint64_t elements = h->n;
+        if(i == BOSS_COLOR_RUNS)
+            elements = section->length/section->width;
+        else if(i == BOSS_COVERAGE && section->length >= h->n && section->length <= BOSS_COVERAGE_MAX_BYTES*h->n)
+            elements = section->length;
+        else if(i == BOSS_SL_FLAGS || i == BOSS_LCP_FLAGS)
+            elements = (h->n+63)/64;
+        if((section->length && section->offset + section->length > boss->size) || section->width != sectionWidths[i] || section->length != elements*section->width)
+            valid = 0;
+        else if(verify && bossChecksum(BOSS_CHECKSUM_START, data + section->offset, section->length) != section->checksum)
+            valid = 0;
+    }
+
+    if(!valid){
+        fprintf(stderr, "%s is corrupted\n", fileName);
+        bossFileClose(boss);
+        return NULL;
+    }
+
+    madvise(data, boss->size, MADV_SEQUENTIAL);
+
+    return boss;
+}
+
+void bossFileClose(bossFile *boss){
+    munmap(boss->data, boss->size);
+    free(boss);
+}
+
+void* bossFileSection(bossFile *boss, int section){
+    return boss->data + boss->sections[section].offset;
+}
+
+size_t bossFileSectionSize(bossFile *boss, int section){
+    return boss->sections[section].length/boss->sections[section].width;
+}
+
+int bossCoverageEncode(unsigned char *buffer, uint32_t coverage){
+    int bytes = 0;
+    while(coverage >= 0x80){
+        buffer[bytes++] = (coverage & 0x7f) | 0x80;
+        coverage >>= 7;
+    }
+    buffer[bytes++] = coverage;
+    return bytes;
+}
@@ -0,0 +1,118 @@
+#ifndef BOSSFILE_H
+#define BOSSFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* BOSS file layout (native byte order):
+     bossFileHeader
+     uint64_t totalSampleColorsInBoss[samples]
+     uint64_t totalSampleCoverageInBoss[samples]
+     bossSectionEntry sections[sectionCount]
+     sections, each one starting at a BOSS_FILE_ALIGNMENT multiple
+ */
+
+#define BOSS_FILE_MAGIC "GCBBBOSS"
+#define BOSS_FILE_VERSION 5
+#define BOSS_FILE_ALIGNMENT 4096
+
+// FNV-1a offset basis, initial value of bossChecksum
+#define BOSS_CHECKSUM_START 14695981039346656037ULL
+
+// Sections of a BOSS file
+enum {
+    BOSS_LAST,
+    BOSS_W,
+    BOSS_WM,
+    BOSS_COLORS,
+    BOSS_COVERAGE,
+    BOSS_SUMMARIZED_LCP,
+    BOSS_SUMMARIZED_SL,
+    BOSS_COLOR_RUNS,
+    BOSS_SL_FLAGS,
+    BOSS_LCP_FLAGS,
+    BOSS_SECTIONS
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize; // bytes before the first section
+    uint64_t n; // BOSS length
+    uint32_t k;
+    uint32_t samples;
+    uint32_t minAbundance;
+    uint32_t sectionCount;
+    uint64_t C[6]; // $, A, C, G, N, T
+    uint64_t checksum; // of the whole header, computed with this field set to 0
+} bossFileHeader;
+
+/* Element of BOSS_COLOR_RUNS, the colors of the (k+1)-mers (edges with
+   summarizedSL > k) as runs of the same color. Every other section has an
+   element per edge. A longer run is split in runs of BOSS_COLOR_RUN_MAX */
+typedef struct {
+    uint16_t color;
+    uint16_t length;
+} bossColorRun;
+
+#define BOSS_COLOR_RUN_MAX UINT16_MAX
+
+/* BOSS_SL_FLAGS and BOSS_LCP_FLAGS are bitvectors of 64 bit words, bit i
+   of an edge i whose summarizedSL (or summarizedLCP) is larger than k */
+#define BOSS_FLAG(flags, i) (((flags)[(i) >> 6] >> ((i) & 63)) & 1)
+
+/* BOSS_COVERAGE has the coverage of each edge as a varint, 7 bits per byte
+   from the lowest ones and the highest bit set in every byte but the last,
+   so the usual coverage of 1 takes a byte */
+#define BOSS_COVERAGE_MAX_BYTES 5
+
+typedef struct {
+    uint64_t offset;
+    uint64_t length; // in bytes
+    uint32_t width; // bytes per element
+    uint32_t reserved;
+    uint64_t checksum;
+} bossSectionEntry;
+
+typedef struct {
+    bossFileHeader *header;
+    uint64_t *totalSampleColorsInBoss;
+    uint64_t *totalSampleCoverageInBoss;
+    bossSectionEntry *sections;
+    char *data;
+    size_t size;
+} bossFile;
+
+uint64_t bossChecksum(uint64_t checksum, const void *data, size_t len);
+
+/* Packs the BOSS streams in sectionFiles[BOSS_SECTIONS] into fileName,
+   returns 0 on success */
+int bossFileWrite(char *fileName, char **sectionFiles, uint64_t n, int k, int samples, int minAbundance, unsigned long *C, size_t *totalSampleColorsInBoss, size_t *totalSampleCoverageInBoss);
+
+/* Maps fileName into memory, checking its header. If verify is set the
+   checksum of every section is also checked. Returns NULL on error */
+bossFile* bossFileOpen(char *fileName, int verify);
+
+void bossFileClose(bossFile *boss);
+
+// Pointer to the first element of a section
+void* bossFileSection(bossFile *boss, int section);
+
+// Number of elements of a section
+size_t bossFileSectionSize(bossFile *boss, int section);
+
+// Writes coverage as a BOSS_COVERAGE varint to buffer, returns its bytes
+int bossCoverageEncode(unsigned char *buffer, uint32_t coverage);
+
+// Coverage of the edge at *cursor of BOSS_COVERAGE, moving *cursor to the next edge
+static inline uint32_t bossCoverageNext(const unsigned char **cursor){
+    uint32_t coverage = 0;
+    int shift = 0;
+    while(**cursor & 0x80){
+        coverage |= (uint32_t)(*(*cursor)++ & 0x7f) << shift;
+        shift += 7;
+    }
+    return coverage | (uint32_t)*(*cursor)++ << shift;
+}
+
+#endif
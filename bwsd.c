@@ -3,22 +3,22 @@
 #include <math.h>
 #include <string.h>
 #include <libgen.h>
-#include <time.h>
+#include <pthread.h>
 #include "bwsd.h"
 #include "external.h"
+#include "bossfile.h"
+#include "metrics.h"
 #include "lib/rankbv.h"
 
 #define FILE_PATH 1024
+// bytes of pair states scanned together by bwsdPairs, about the size of an L2 cache
+#define BWSD_PAIRS_CACHE (256 << 10)
+// times the pairs with a bound are checked along the scan of the color runs
+#define BWSD_BOUND_CHECKS 64
 
 #define MIN(a,b) (((a)<(b))?(a):(b))
 #define MAX(a,b) (((a)>(b))?(a):(b))
 
-typedef struct {
-    unsigned long bossLen;
-    size_t *totalSampleColorsInBoss;
-    size_t *totalSampleCoverageInBoss;
-} bossInfo;
-
 double log2(double i){
 	return log(i)/log(2);
 }
@@ -56,239 +56,379 @@ double bwsdShannonEntropy(size_t *t, size_t s, size_t n){
     return value;
 }
 
-void applyCoverageMerge(int zeroCoverage, int oneCoverage, size_t *rlFreq, size_t *pos){
-    while(zeroCoverage > 0 && oneCoverage > 0){
-        rlFreq[(*pos)++] = 1;
-        rlFreq[(*pos)++] = 1;
-        zeroCoverage--;
-        oneCoverage--;
+struct bwsdPair {
+    int consider1, consider2;
+    int current;
+    size_t pos; // runs ended, the rlFreq[0..pos-1] of a run lengths array
+    size_t run; // rlFreq[pos], the run being counted
+    size_t lastColor, lastCoverage; // of the last (k+1)-mer of the pair
+
+    // terms of the ended runs, length is the sum of their lengths
+    size_t *t;
+    short *genome0, *genome1;
+    size_t termsCapacity, maxFreq, s, length;
+
+    // the pair stops once its expectation can not be smaller than bound
+    double bound;
+    int stopped;
+};
+
+static void bwsdPairInit(bwsdPair *p, int consider1, int consider2){
+    memset(p, 0, sizeof(bwsdPair));
+    p->consider1 = p->current = consider1;
+    p->lastColor = consider1;
+    p->termsCapacity = 16;
+    p->t = calloc(p->termsCapacity, sizeof(size_t));
+    p->genome0 = calloc(p->termsCapacity, sizeof(short));
+    p->genome1 = calloc(p->termsCapacity, sizeof(short));
+    p->consider2 = consider2;
+    p->bound = INFINITY;
+}
+
+static void bwsdPairFree(bwsdPair *p){
+    free(p->t); free(p->genome0); free(p->genome1);
+}
+
+/* Ends the run at pos with length run. The next run starts as it would in
+   a run lengths array where rlFreq[consider1] = consider1 */
+static void bwsdPairEmit(bwsdPair *p, size_t run){
+    if(run >= p->termsCapacity){
+        size_t capacity = MAX(2*p->termsCapacity, run+1);
+        p->t = realloc(p->t, capacity*sizeof(size_t));
+        p->genome0 = realloc(p->genome0, capacity*sizeof(short));
+        p->genome1 = realloc(p->genome1, capacity*sizeof(short));
+        memset(p->t+p->termsCapacity, 0, (capacity-p->termsCapacity)*sizeof(size_t));
+        memset(p->genome0+p->termsCapacity, 0, (capacity-p->termsCapacity)*sizeof(short));
+        memset(p->genome1+p->termsCapacity, 0, (capacity-p->termsCapacity)*sizeof(short));
+        p->termsCapacity = capacity;
+    }
+    p->maxFreq = MAX(p->maxFreq, run);
+    if(run > 0){
+        p->s++;
+        p->length += run;
+        p->t[run]++;
+        if(p->pos%2)
+            p->genome0[run] = 1;
+        else
+            p->genome1[run] = 1;
+    }
+    p->pos++;
+    p->run = p->pos == (size_t)p->consider1 ? p->consider1 : 0;
+}
+
+/* Intermixes the coverage of a (k+1)-mer of both genomes: min(zeroCoverage,
+   oneCoverage) pairs of runs of length 1, then the rest of the larger one
+   in a single run. The runs of length 1 are added at once, as 2*min calls
+   of bwsdPairEmit(pair, 1) would, so it does not depend on the coverage */
+void applyCoverageMerge(int zeroCoverage, int oneCoverage, bwsdPair *pair){
+    int common = MIN(zeroCoverage, oneCoverage);
+    if(common > 0){
+        // consecutive runs, so both genomes have runs of length 1
+        pair->maxFreq = MAX(pair->maxFreq, 1);
+        pair->s += 2*(size_t)common;
+        pair->t[1] += 2*(size_t)common;
+        pair->genome0[1] = pair->genome1[1] = 1;
+        pair->pos += 2*(size_t)common;
+        pair->run = pair->pos == (size_t)pair->consider1 ? pair->consider1 : 0;
+        zeroCoverage -= common;
+        oneCoverage -= common;
     }
     int last = zeroCoverage == 0 ? 1 : 0;
     if(last == 1 && oneCoverage){
-        rlFreq[(*pos)++] = 0;
-        rlFreq[(*pos)++] = oneCoverage;
+        bwsdPairEmit(pair, 0);
+        bwsdPairEmit(pair, oneCoverage);
     } else if(zeroCoverage) {
-        rlFreq[(*pos)++] = zeroCoverage;
-        rlFreq[(*pos)++] = 0;
+        bwsdPairEmit(pair, zeroCoverage);
+        bwsdPairEmit(pair, 0);
     }
     return;
 }
 
-bossInfo *getBossInfo(char* file1, char* file2, int k, int samples){
-    FILE *infoFile = getBossInfoFile(file1, file2, k, 0);
-
-    bossInfo *bossInfo = calloc(1,sizeof(*bossInfo));
-    bossInfo->totalSampleColorsInBoss = calloc(samples, sizeof(size_t));
-    bossInfo->totalSampleCoverageInBoss = calloc(samples, sizeof(size_t));
-
-    fscanf(infoFile, "%ld", &(bossInfo->bossLen));
-    for(int i = 0; i < samples; i++){
-        fscanf(infoFile, "%ld", &(bossInfo->totalSampleColorsInBoss[i]));
+/* Lists the pairs of each color that did not stop, colorPairs[colorStart[c]..colorStart[c+1]-1]
+   for color c. colorStart has samples+1 positions and colorPairs 2*pairCount */
+static void bwsdPairsByColor(bwsdPair *pairs, int pairCount, int samples, int *colorStart, int *colorPairs){
+    int x;
+    memset(colorStart, 0, (samples+1)*sizeof(int));
+    for(x = 0; x < pairCount; x++){
+        if(pairs[x].stopped)
+            continue;
+        colorStart[pairs[x].consider1+1]++;
+        colorStart[pairs[x].consider2+1]++;
     }
-    for(int i = 0; i < samples; i++){
-        fscanf(infoFile, "%ld", &(bossInfo->totalSampleCoverageInBoss[i]));
+    for(x = 0; x < samples; x++) colorStart[x+1] += colorStart[x];
+    int *next = malloc(samples*sizeof(int));
+    memcpy(next, colorStart, samples*sizeof(int));
+    for(x = 0; x < pairCount; x++){
+        if(pairs[x].stopped)
+            continue;
+        colorPairs[next[pairs[x].consider1]++] = x;
+        colorPairs[next[pairs[x].consider2]++] = x;
     }
+    free(next);
+}
 
-    fclose(infoFile);
-
-    return bossInfo;
+/* Stops the pairs whose expectation can not be smaller than their bound,
+   returns how many. The expectation is L/s-1, L the sum of the run lengths
+   and s the number of runs. The remaining R colors of a pair add them to
+   its runs, or start at most R new ones (one more for the run of consider1
+   of bwsdPairEmit), so in the end L >= length+run+R and s <= s+R+2 */
+static int bwsdPairsBound(bwsdPair *pairs, int pairCount, size_t *remaining){
+    int x, stopped = 0;
+    for(x = 0; x < pairCount; x++){
+        bwsdPair *p = &pairs[x];
+        if(p->stopped || isinf(p->bound))
+            continue;
+        size_t left = remaining[p->consider1] + remaining[p->consider2];
+        double expectation = (double)(p->length + p->run + left)/(p->s + left + 2) - 1.0;
+        if(expectation > p->bound){
+            p->stopped = 1;
+            stopped++;
+        }
+    }
+    return stopped;
 }
 
-void bwsd(char* file1, char* file2, int k, double *expectation, double *entropy, int mem, int printBoss, int consider1, int consider2){
+/* Run lengths of every pair along the (k+1)-mers of the BOSS, in a single
+   scan. Each edge only updates the pairs of its color, whose runs are
+   added to their terms as soon as they end. withCoverage is a constant in
+   each variant below: the colors only one scans the color runs of the BOSS
+   instead of its edges, and has no coverage branches. It also stops the
+   pairs with a bound as soon as it is sure they exceed it (bwsdPairsBound) */
+static inline __attribute__((always_inline)) void bwsdPairsTerms(bossFile *boss, bwsdPair *pairs, int pairCount, const int withCoverage){
     size_t i;
+    int x;
+
+    int samples = boss->header->samples;
+    unsigned long n = boss->header->n;
+
+    short *colors = (short*)bossFileSection(boss, BOSS_COLORS);
+    uint64_t *LCPFlags = (uint64_t*)bossFileSection(boss, BOSS_LCP_FLAGS);
+    uint64_t *SLFlags = (uint64_t*)bossFileSection(boss, BOSS_SL_FLAGS);
+    const unsigned char *coverage = (unsigned char*)bossFileSection(boss, BOSS_COVERAGE);
+    bossColorRun *colorRuns = (bossColorRun*)bossFileSection(boss, BOSS_COLOR_RUNS);
+    size_t runs = bossFileSectionSize(boss, BOSS_COLOR_RUNS);
+
+    // pairs of each color
+    int *colorStart = malloc((samples+1)*sizeof(int));
+    int *colorPairs = malloc(MAX(2*pairCount, 1)*sizeof(int));
+    bwsdPairsByColor(pairs, pairCount, samples, colorStart, colorPairs);
+
+    // colors of each genome not scanned yet, only if some pair has a bound
+    size_t *remaining = NULL;
+    for(x = 0; x < pairCount && !withCoverage && remaining == NULL; x++){
+        if(!isinf(pairs[x].bound))
+            remaining = calloc(samples, sizeof(size_t));
+    }
+    for(i = 0; i < runs && remaining != NULL; i++)
+        remaining[colorRuns[i].color] += colorRuns[i].length;
+    size_t check = MAX(runs/BWSD_BOUND_CHECKS, 1);
+
+    // a run of length l of a color adds l to the run of each of its pairs, or ends it
+    for(i = 0; i < runs && !withCoverage; i++){
+        int color = colorRuns[i].color;
+        if(remaining != NULL){
+            if(i > 0 && i%check == 0 && bwsdPairsBound(pairs, pairCount, remaining) > 0)
+                bwsdPairsByColor(pairs, pairCount, samples, colorStart, colorPairs);
+            remaining[color] -= colorRuns[i].length;
+        }
+        for(x = colorStart[color]; x < colorStart[color+1]; x++){
+            bwsdPair *p = &pairs[colorPairs[x]];
+            if(color == p->current){
+                p->run += colorRuns[i].length;
+            } else {
+                p->current = color;
+                bwsdPairEmit(p, p->run);
+                p->run = colorRuns[i].length;
+            }
+        }
+    }
 
-    bossInfo *info = getBossInfo(file1, file2, k, 2);
-    unsigned long n = info->bossLen;
-    size_t totalCoverage = info->totalSampleCoverageInBoss[consider1] +  info->totalSampleCoverageInBoss[consider2];
-    #if COVERAGE
-        size_t size = totalCoverage+1;
-    #else
-        size_t size = n+1;
-    #endif
-
-    // Count computation time
-    clock_t start, end;
-    double cpuTimeUsed;
-
-    start = clock();
-
-    short *colors = (short*)calloc((mem+1), sizeof(short));
-    short *summarizedLCP = (short*)calloc((mem+1), sizeof(short));
-    short *summarizedSL = (short*)calloc((mem+1), sizeof(short));
-    int *coverage = (int*)calloc((mem+1), sizeof(int));
-
-    char colorFileName[FILE_PATH];
-    char summarizedLCPFileName[FILE_PATH];
-    char summarizedSLFileName[FILE_PATH];
-    char coverageFileName[FILE_PATH];
-
-    snprintf(colorFileName, FILE_PATH, "results/%s-%s_k_%d.2.colors", file1, file2, k);
-    snprintf(summarizedLCPFileName, FILE_PATH, "results/%s-%s_k_%d.2.summarizedLCP", file1, file2, k);
-    snprintf(summarizedSLFileName, FILE_PATH, "results/%s-%s_k_%d.2.summarizedSL", file1, file2, k);
-    snprintf(coverageFileName, FILE_PATH, "results/%s-%s_k_%d.4.coverage", file1, file2, k);
-    
-    FILE *colorsFile = fopen(colorFileName, "rb");
-    FILE *summarizedLCPFile = fopen(summarizedLCPFileName, "rb");
-    FILE *summarizedSLFile = fopen(summarizedSLFileName, "rb");
-    FILE *coverageFile = fopen(coverageFileName, "rb");
-
-    fread(colors, sizeof(short), mem, colorsFile);
-    fread(summarizedLCP, sizeof(short), mem, summarizedLCPFile);
-    fread(summarizedSL, sizeof(short), mem, summarizedSLFile);
-    fread(coverage, sizeof(int), mem, coverageFile);
-
-    size_t *rlFreq = (size_t*)calloc(size, sizeof(size_t));
-    size_t maxFreq = 0;
-
-    int current = consider1;
-    rlFreq[consider1] = consider1;
-    size_t pos = 0; // size of run_length
-    int blockPos = 0;
-    size_t rmq = 0;
-    #if COVERAGE
-    size_t consider1LastColorValue = consider1;
-    size_t consider1LastCoverageValue = 0; 
-    #endif
+    for(i = 0; i < n && withCoverage; i++){
+        int color = colors[i];
+        int rmqLarger = BOSS_FLAG(LCPFlags, i); // summarizedLCP[i] > k
+        size_t edgeCoverage = bossCoverageNext(&coverage);
+        for(x = colorStart[color]; x < colorStart[color+1]; x++){
+            bwsdPair *p = &pairs[colorPairs[x]];
+
+            // If we have two same (k+1)-mers from distinct genomes, 
+            // we break down their coverage frequencies and merge then 
+            // intending to increase their similarity.
+
+            // For instance, if a (k+1)-mer occurs 4 times in genome 0
+            // and 3 times in genome 1 we have the following:
+            // 0^4 1^3 = 0^1 1^1 0^1 1^1 0^1 1^1 0^1
+
+            // We always intermix these value between 1^0 and 0^0 in 
+            // order to "separate" the intermix from the "default" bwsd.
+            // For example, 
+            // ... 0^4 1^3 ... = ... 1^0 (0^1 1^1 0^1 1^1 0^1 1^1 0^1) 1^0 ...
+            if(p->lastColor == p->consider1 && color == p->consider2 && rmqLarger && (p->lastCoverage > 1 || edgeCoverage > 1)){
+                bwsdPairEmit(p, MAX((int)(p->run)-1, 0)); // decrease last 0 run because it is going to be intermixed with the current color
+                bwsdPairEmit(p, 0); // add 1^0, since we are entering an intermix area and the last position is from genome 0
+                applyCoverageMerge(p->lastCoverage, edgeCoverage, p);
+                // set current to 0 to "restart" the bwsd 0s and 1s count
+                p->current = 0;
+            } else if(BOSS_FLAG(SLFlags, i)){
+                if(color == p->current){
+                    p->run++;
+                } else {
+                    p->current = color;
+                    bwsdPairEmit(p, p->run);
+                    p->run = 1;
+                }
+                p->lastColor = color;
+                p->lastCoverage = edgeCoverage;
+            }
+        }
+    }
 
-    for(i = 0; i < n; i++){     
-        if(i != 0 && blockPos%mem == 0){
-            fread(colors, sizeof(short), mem, colorsFile);
+    // the last run of each pair
+    for(x = 0; x < pairCount; x++)
+        bwsdPairEmit(&pairs[x], pairs[x].run);
 
-            fread(summarizedLCP, sizeof(short), mem, summarizedLCPFile);
+    free(colorStart);
+    free(colorPairs);
+    free(remaining);
+}
 
-            fread(summarizedSL, sizeof(short), mem, summarizedSLFile);
+static void bwsdPairsTermsColors(bossFile *boss, bwsdPair *pairs, int pairCount){
+    bwsdPairsTerms(boss, pairs, pairCount, 0);
+}
 
-            fread(coverage, sizeof(int), mem, coverageFile);
+static void bwsdPairsTermsCoverage(bossFile *boss, bwsdPair *pairs, int pairCount){
+    bwsdPairsTerms(boss, pairs, pairCount, 1);
+}
 
-            blockPos=0;
+// indexed by runMode.coverage
+static void (*const bwsdPairsTermsVariants[2])(bossFile*, bwsdPair*, int) = { bwsdPairsTermsColors, bwsdPairsTermsCoverage };
+
+void bwsdPairs(bossFile *boss, char* path, int *pairs, int pairCount, double *expectation, double *entropy, bwsdNeighbors *neighbors){
+    int x, batch, count, stopped = 0;
+
+    phaseMetrics metrics;
+    metricsStart(&metrics, "BWSD computation");
+    metrics.k = boss->header->k;
+
+    /* pairs in the order they are computed. With neighbors, the first knn
+       pairs of each genome in pairs go first, in batches of their own, so
+       every genome has its knn neighbors (and the other pairs a bound)
+       before the other pairs are scanned */
+    int *order = malloc(MAX(pairCount, 1)*sizeof(int));
+    int seeds = 0, next = 0;
+    if(neighbors != NULL){
+        int *pairsOf = calloc(neighbors->genomes, sizeof(int));
+        char *seed = calloc(MAX(pairCount, 1), sizeof(char));
+        for(x = 0; x < pairCount; x++){
+            if(pairsOf[pairs[2*x]] < neighbors->knn || pairsOf[pairs[2*x+1]] < neighbors->knn){
+                pairsOf[pairs[2*x]]++;
+                pairsOf[pairs[2*x+1]]++;
+                seed[x] = 1;
+                order[seeds++] = x;
+            }
         }
+        next = seeds;
+        for(x = 0; x < pairCount; x++)
+            if(!seed[x]) order[next++] = x;
+        free(pairsOf);
+        free(seed);
+    } else {
+        for(x = 0; x < pairCount; x++) order[x] = x;
+    }
 
-        if(colors[blockPos] != consider1 && colors[blockPos] != consider2) {
-            rmq = MIN(rmq, summarizedLCP[blockPos]);
-            blockPos++;
-            continue;
-        } else {
-            rmq = summarizedLCP[blockPos];
+    // the state of the pairs of a batch stays in cache during its scan
+    int batchSize = MAX(1, BWSD_PAIRS_CACHE/(int)sizeof(bwsdPair));
+    bwsdPair *batchPairs = malloc(MIN(batchSize, MAX(pairCount, 1))*sizeof(bwsdPair));
+    for(batch = 0; batch < pairCount; batch += count){
+        count = MIN(batchSize, (batch < seeds ? seeds : pairCount)-batch);
+        for(x = 0; x < count; x++){
+            int pair = order[batch+x];
+            bwsdPairInit(&batchPairs[x], pairs[2*pair], pairs[2*pair+1]);
+            if(neighbors != NULL)
+                batchPairs[x].bound = bwsdNeighborsBound(neighbors, batchPairs[x].consider1, batchPairs[x].consider2);
         }
 
-        #if COVERAGE 
-        // If we have two same (k+1)-mers from distinct genomes, 
-        // we break down their coverage frequencies and merge then 
-        // intending to increase their similarity.
-
-        // For instance, if a (k+1)-mer occurs 4 times in genome 0
-        // and 3 times in genome 1 we have the following:
-        // 0^4 1^3 = 0^1 1^1 0^1 1^1 0^1 1^1 0^1
-
-        // We always intermix these value between 1^0 and 0^0 in 
-        // order to "separate" the intermix from the "default" bwsd.
-        // For example, 
-        // ... 0^4 1^3 ... = ... 1^0 (0^1 1^1 0^1 1^1 0^1 1^1 0^1) 1^0 ...
-        if(consider1LastColorValue == consider1 && colors[blockPos] == consider2 && rmq > k && (consider1LastCoverageValue > 1 || coverage[blockPos] > 1)){
-            rlFreq[pos] = MAX((int)(rlFreq[pos])-1, 0); // decrease last 0 rlFreq because it is going to be intermixed with the current color
-            pos++;
-            rlFreq[pos++] = 0; // add 1^0 to rlFreq, since we are entering an intermix area and the last position is from genome 0
-            applyCoverageMerge(consider1LastCoverageValue, coverage[blockPos], rlFreq, &pos);
-            // set current to 0 to "restart" the bwsd 0s and 1s count
-            current = 0;
-        } else { 
-        #endif
-            if(summarizedSL[blockPos] > k){
-                if(colors[blockPos] == current){
-                    rlFreq[pos]++;
-                } else {
-                    current = colors[blockPos];
-                    pos++;
-                    rlFreq[pos]=1;
-                }
-                #if COVERAGE
-                consider1LastColorValue = colors[blockPos];
-                consider1LastCoverageValue = coverage[blockPos];
-                #endif
+        bwsdPairsTermsVariants[runMode.coverage](boss, batchPairs, count);
+
+        for(x = 0; x < count; x++){
+            bwsdPair *p = &batchPairs[x];
+            int pair = order[batch+x];
+            if(p->stopped){
+                expectation[pair] = entropy[pair] = NAN;
+                stopped++;
+            } else {
+                expectation[pair] = bwsdExpectation(p->t, p->s, p->maxFreq);
+                entropy[pair] = bwsdShannonEntropy(p->t, p->s, p->maxFreq);
+                if(neighbors != NULL)
+                    bwsdNeighborsAdd(neighbors, p->consider1, p->consider2, expectation[pair], entropy[pair]);
             }
-        #if COVERAGE
+            bwsdPairFree(p);
         }
-        #endif
-        blockPos++;
     }
-    pos++;
+    free(order);
+    free(batchPairs);
 
-    // check if sum rlFreq = n;
-    // update maxFreq;
-    for(i = 0; i < pos; i++){
-        maxFreq = MAX(rlFreq[i], maxFreq);
-    }
+    metricsStop(&metrics);
 
-    size_t s = pos;
+    printf("BWSD computation time (%d pairs): %lf seconds\n", pairCount, metrics.wallTime);
+    if(neighbors != NULL)
+        printf("%d pairs stopped early, they are not among the %d nearest genomes of either genome\n", stopped, neighbors->knn);
 
-    // update s removing 0's
-    for(i = 0; i < pos; i++){
-        if(rlFreq[i] == 0) s--;
-    }
-
-    free(colors); free(coverage); free(summarizedLCP); free(summarizedSL);
-
-    // computes every t_(k_j), where 1 <= j <= maxFreq
-    size_t *t = (size_t*) calloc((maxFreq+10), sizeof(size_t));
-    short *genome0 = (short*) calloc((maxFreq+10), sizeof(short));
-    short *genome1 = (short*) calloc((maxFreq+10), sizeof(short));
-    for(i = 0; i < pos; i++){
-        if(rlFreq[i] > 0){
-            t[rlFreq[i]]++;
-            if(i%2)
-                genome0[rlFreq[i]] = 1;
-            else 
-                genome1[rlFreq[i]] = 1;
-        } 
-    }
+    FILE *infoFile = getInfoFile(path, NULL, boss->header->k, 1);
+    metricsPrint(infoFile, &metrics);
+    fclose(infoFile);
+}
 
-    *expectation = bwsdExpectation(t, s, maxFreq);
-    *entropy = bwsdShannonEntropy(t, s, maxFreq);
+int bwsd(bossFile *boss, char* file1, char* file2, double *expectation, double *entropy, int mem, int printBoss, int consider1, int consider2, double bound){
+    int k = boss->header->k;
+    unsigned long n = boss->header->n;
+    size_t totalCoverage = boss->totalSampleCoverageInBoss[consider1] +  boss->totalSampleCoverageInBoss[consider2];
 
-    fclose(colorsFile);
-    fclose(summarizedLCPFile);
-    fclose(summarizedSLFile);
-    fclose(coverageFile);
-    
-    if(!printBoss){
-        // remove(colorFileName);
-        // remove(summarizedLCPFileName);
-        // remove(summarizedSLFileName);
-        // remove(coverageFileName);
+    // Count computation time
+    phaseMetrics metrics;
+    metricsStart(&metrics, "BWSD computation");
+    metrics.k = boss->header->k;
+
+    // a batch of a single pair
+    bwsdPair pair;
+    bwsdPairInit(&pair, consider1, consider2);
+    pair.bound = bound;
+    bwsdPairsTermsVariants[runMode.coverage](boss, &pair, 1);
+    int stopped = pair.stopped;
+
+    if(stopped){
+        *expectation = *entropy = NAN;
+        printf("BWSD of %s and %s stopped early, its expectation is larger than %lf\n", file1, file2, bound);
+    } else {
+        *expectation = bwsdExpectation(pair.t, pair.s, pair.maxFreq);
+        *entropy = bwsdShannonEntropy(pair.t, pair.s, pair.maxFreq);
     }
 
     FILE* infoFile = getInfoFile(file1, file2, k, 1);
 
-    #if DEBUG
-    printBWSDDebug(infoFile, file1, file2, totalCoverage, n, pos, s, maxFreq, t, genome0, genome1);
-    #endif
+    if(runMode.debug && !stopped)
+        printBWSDDebug(infoFile, file1, file2, totalCoverage, n, pair.pos, pair.s, pair.maxFreq, pair.t, pair.genome0, pair.genome1);
 
-    free(rlFreq); 
-    free(genome0); free(genome1);
-    free(t);
+    bwsdPairFree(&pair);
 
-    end = clock();
+    metricsStop(&metrics);
 
-    cpuTimeUsed = ((double) (end - start)) / CLOCKS_PER_SEC;
+    printf("BWSD computation time: %lf seconds\n", metrics.wallTime);
 
-    printf("BWSD computation time: %lf seconds\n", cpuTimeUsed);
-
-    fprintf(infoFile, "BWSD computation time: %lf seconds\n", cpuTimeUsed);
+    metricsPrint(infoFile, &metrics);
 
     fclose(infoFile);
 
-    return;
+    return stopped;
 }
 
 void printBWSDDebug(FILE* infoFile, char* file1, char* file2, size_t totalCoverage, size_t n, size_t pos, size_t s, size_t maxFreq, size_t* t, short* genome0, short* genome1){
     size_t i;
 
     fprintf(infoFile, "BWSD info of %s and %s genomes merge:\n\n", file1, file2);
-    #if COVERAGE
+    if(runMode.coverage)
         fprintf(infoFile, "totalCoverage = %ld\n", totalCoverage);
-    #else
+    else
         fprintf(infoFile, "n = %ld\n", n);
-    #endif
     fprintf(infoFile, "pos = %ld\n\n", pos);
 
     fprintf(infoFile, "s = %ld\n\n", s);
@@ -310,10 +450,11 @@ void printBWSDDebug(FILE* infoFile, char* file1, char* file2, size_t totalCovera
     fprintf(infoFile, "\n");
 }
 
-int getLastLCPGreaterThanKPos(short *lcp, int k, int intervalStart, int intervalEnd){
+// intervalStart and intervalEnd are positions of the block starting at offset
+int getLastLCPGreaterThanKPos(uint64_t *LCPFlags, size_t offset, int intervalStart, int intervalEnd){
     int pos = intervalStart;
     for(int z = intervalStart+1; z < intervalEnd; z++){
-        if(lcp[z] > k) {
+        if(BOSS_FLAG(LCPFlags, offset+z)) {
             pos++;
         } else {
             break;
@@ -322,113 +463,119 @@ int getLastLCPGreaterThanKPos(short *lcp, int k, int intervalStart, int interval
     return pos;
 }
 
-void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De){
+/* Adds the terms of the pairs (i, j), i in genomes[0..genomeCount-1] (in
+   increasing order) and j > i, to tij. The state carried between blocks is
+   per pair and per genome i, so disjoint sets of genomes can be computed at
+   the same time. withCoverage is a constant in each variant below: the
+   colors only one sets the bits of its blocks from the color runs of the
+   BOSS, so its blocks only have (k+1)-mers, and has no coverage branches */
+static inline __attribute__((always_inline)) void bwsdAllTerms(bossFile *boss, int mem, size_t **tij, size_t *tijMaxFreq, int *genomes, int genomeCount, const int withCoverage){
     size_t i, j, z;
-
-    // Count computation time
-    clock_t startClock, endClock;
-    double cpuTimeUsed;
-
-    startClock = clock();
-
-    bossInfo *info = getBossInfo(path, NULL, k, samples);
-    unsigned long n = info->bossLen;
-    #if COVERAGE
-        size_t *sampleSize = info->totalSampleCoverageInBoss;
-    #else
-        size_t *sampleSize = info->totalSampleColorsInBoss;
-    #endif
-    
-    short *colors = (short*)calloc((mem+1), sizeof(short));
-    short *summarizedLCP = (short*)calloc((mem+1), sizeof(short));
-    short *summarizedSL = (short*)calloc((mem+1), sizeof(short));
-    int *coverage = (int*)calloc((mem+1), sizeof(int));
-
-    char colorFileName[FILE_PATH];
-    char summarizedLCPFileName[FILE_PATH];
-    char summarizedSLFileName[FILE_PATH];
-    char coverageFileName[FILE_PATH];
-
-    snprintf(colorFileName, FILE_PATH, "results/%s_k_%d.2.colors", path, k);
-    snprintf(summarizedLCPFileName, FILE_PATH, "results/%s_k_%d.2.summarizedLCP", path, k);
-    snprintf(summarizedSLFileName, FILE_PATH, "results/%s_k_%d.2.summarizedSL", path, k);
-    snprintf(coverageFileName, FILE_PATH, "results/%s_k_%d.4.coverage", path, k);
-    
-    FILE *colorsFile = fopen(colorFileName, "rb");
-    FILE *summarizedLCPFile = fopen(summarizedLCPFileName, "rb");
-    FILE *summarizedSLFile = fopen(summarizedSLFileName, "rb");
-    FILE *coverageFile = fopen(coverageFileName, "rb");
+    int g;
+
+    int samples = boss->header->samples;
+    unsigned long n = boss->header->n;
+
+    // blocks of mem values of the mapped BOSS sections
+    short *colors = (short*)bossFileSection(boss, BOSS_COLORS);
+    uint64_t *LCPFlags = (uint64_t*)bossFileSection(boss, BOSS_LCP_FLAGS);
+    uint64_t *SLFlags = (uint64_t*)bossFileSection(boss, BOSS_SL_FLAGS);
+    const unsigned char *coverageVarints = (unsigned char*)bossFileSection(boss, BOSS_COVERAGE);
+    int *coverage = withCoverage ? malloc(mem*sizeof(int)) : NULL; // of the block
+    bossColorRun *colorRuns = (bossColorRun*)bossFileSection(boss, BOSS_COLOR_RUNS);
+    size_t runs = bossFileSectionSize(boss, BOSS_COLOR_RUNS);
+    size_t run = 0, runOffset = 0; // first run of the next block and its (k+1)-mers already in a block
+    size_t blockStart = 0;
+
+    // positions of the blocks, edges or (k+1)-mers
+    size_t length = n;
+    if(!withCoverage){
+        length = 0;
+        for(z = 0; z < runs; z++) length += colorRuns[z].length;
+        length = MAX(length, 1);
+    }
 
     int tijSize = ((samples*(samples-1))/2)+1;
 
     size_t *lastJRank = calloc(tijSize, sizeof(size_t));
     size_t *lastIRank = calloc(tijSize, sizeof(size_t));
 
-    size_t (**tij) = calloc(tijSize, sizeof(*tij));
-    for(i = 0; i < samples-1; i++){
-        for(j = i+1; j < samples; j++){
-            int row = (((j-1)*(j))/2)+i;
-            tij[row] = (size_t*) calloc(MAX(sampleSize[i],sampleSize[j])+2, sizeof(size_t));
-        }
-    } 
-    size_t *tijMaxFreq = calloc(tijSize, sizeof(size_t));
-
     size_t *iCoverage = calloc(samples, sizeof(size_t));
     size_t *jCoverage = calloc(tijSize+1, sizeof(size_t));
     int needsToFindLcpNextBlock = 1;
 
-    size_t blocks = ((n-1)/mem)+1;
+    size_t blocks = ((length-1)/mem)+1;
+
+    // only genomes from the first i on are read
+    int first = genomes[0];
 
     while(blocks){
         // last block
-        int readSize = blocks == 1 && mem != n ? n%mem : mem; 
-        fread(colors, sizeof(short), readSize, colorsFile);
-        fread(summarizedLCP, sizeof(short), readSize, summarizedLCPFile);
-        fread(summarizedSL, sizeof(short), readSize, summarizedSLFile);
-        fread(coverage, sizeof(int), readSize, coverageFile);
+        int readSize = MIN((size_t)mem, length-blockStart);
+        if(withCoverage && blockStart != 0)
+            colors += mem;
+        size_t offset = blockStart; // of the flags of the block
+        blockStart += readSize;
         rankbv_t **rbv = malloc(samples*sizeof(rankbv_t));
-        for(i = 0; i < samples; i++){
+        for(i = first; i < samples; i++){
             rbv[i] = rankbv_create(readSize, 2);
         }
 
-        for(i = 0; i < readSize; i++){
-            if(summarizedSL[i] > k) {
-                rankbv_setbit(rbv[colors[i]], i);
+        if(withCoverage){
+            for(i = 0; i < readSize; i++){
+                coverage[i] = bossCoverageNext(&coverageVarints);
+                if(BOSS_FLAG(SLFlags, offset+i) && colors[i] >= first) {
+                    rankbv_setbit(rbv[colors[i]], i);
+                }
+            }
+        } else {
+            // the run that crosses the end of the block goes on in the next one
+            for(i = 0; i < readSize && run < runs; run++, runOffset = 0){
+                size_t runEnd = i + MIN(colorRuns[run].length-runOffset, readSize-i);
+                if(colorRuns[run].color >= first){
+                    for(z = i; z < runEnd; z++) rankbv_setbit(rbv[colorRuns[run].color], z);
+                }
+                runOffset += runEnd-i;
+                i = runEnd;
+                if(runOffset < colorRuns[run].length) break;
             }
-        }    
+        }
 
-        for(i = 0; i < samples; i++)
+        for(i = first; i < samples; i++)
             rankbv_build(rbv[i]);
 
-        for(i = 0; i < samples-1; i++){
+        for(g = 0; g < genomeCount; g++){
+            i = genomes[g];
             size_t intervalStart = 0;
             size_t intervalEnd = 0;
 
             for(z = 1; intervalEnd < readSize; z++){
-                if(rankbv_access(rbv[i], intervalStart) == 1) iCoverage[i] = coverage[intervalStart];
+                if(withCoverage && rankbv_access(rbv[i], intervalStart) == 1) iCoverage[i] = coverage[intervalStart];
                 intervalEnd = rankbv_select1(rbv[i], z);
                 // last interval of the block
                 if(intervalEnd == -1) intervalEnd = readSize;
                 int lcpPos = -1;
-                if(needsToFindLcpNextBlock){
-                    lcpPos = getLastLCPGreaterThanKPos(summarizedLCP, k, intervalStart, intervalEnd);
+                if(withCoverage && needsToFindLcpNextBlock){
+                    lcpPos = getLastLCPGreaterThanKPos(LCPFlags, offset, intervalStart, intervalEnd);
                     if(lcpPos < intervalEnd && intervalEnd == readSize && rankbv_access(rbv[i], intervalEnd) == 1)
                         needsToFindLcpNextBlock = 0;
                 }
                 for(j = i+1; j < samples; j++){
                     int row = (((j-1)*(j))/2)+i;
                     size_t qtd;
-                    int firstRbvJ1occurrence;
-                    // if the following result is 0, we are in the
-                    // start of a next block with unfinished interval
-                    if(rankbv_access(rbv[i],intervalStart) == 1) 
-                        firstRbvJ1occurrence = rankbv_select1(rbv[j], rankbv_rank1(rbv[j], intervalStart)+1);
-                    else 
-                        firstRbvJ1occurrence = rankbv_select1(rbv[j], rankbv_rank1(rbv[j], intervalStart));
-                    if(lcpPos >= intervalStart && firstRbvJ1occurrence >= intervalStart && firstRbvJ1occurrence <= lcpPos && firstRbvJ1occurrence != -1){
-                        jCoverage[row] = coverage[firstRbvJ1occurrence];
-                    } else {
-                        jCoverage[row] = 0;
+                    if(withCoverage){
+                        int firstRbvJ1occurrence;
+                        // if the following result is 0, we are in the
+                        // start of a next block with unfinished interval
+                        if(rankbv_access(rbv[i],intervalStart) == 1) 
+                            firstRbvJ1occurrence = rankbv_select1(rbv[j], rankbv_rank1(rbv[j], intervalStart)+1);
+                        else 
+                            firstRbvJ1occurrence = rankbv_select1(rbv[j], rankbv_rank1(rbv[j], intervalStart));
+                        if(lcpPos >= intervalStart && firstRbvJ1occurrence >= intervalStart && firstRbvJ1occurrence <= lcpPos && firstRbvJ1occurrence != -1){
+                            jCoverage[row] = coverage[firstRbvJ1occurrence];
+                        } else {
+                            jCoverage[row] = 0;
+                        }
                     }
                     // workaround for first interval, fail example:
                     // B_0 = 0 1 ...
@@ -439,13 +586,12 @@ void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De){
                     // we store the qtd of the rbv[j]'s in lastJRank
                     if(intervalEnd == readSize && blocks != 1){
                         lastJRank[row] += qtd;
-                        iCoverage[i] = coverage[intervalStart];
+                        if(withCoverage) iCoverage[i] = coverage[intervalStart];
                     } else {
                         qtd += lastJRank[row];
                         lastJRank[row] = 0;
                         if(qtd != 0){
-                            #if COVERAGE
-                                if((jCoverage[row] > 0 && iCoverage[i] > 0) && (jCoverage[row] != 1 || iCoverage[i] != 1)){
+                                if(withCoverage && (jCoverage[row] > 0 && iCoverage[i] > 0) && (jCoverage[row] != 1 || iCoverage[i] != 1)){
                                     int commom =  MIN(jCoverage[row], iCoverage[i]);
                                     int difference = MAX(jCoverage[row], iCoverage[i]) - commom;
                                     tij[row][1] += commom*2;
@@ -454,13 +600,10 @@ void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De){
                                     tij[row][qtd-1]++;
                                     tijMaxFreq[row] = MAX(tijMaxFreq[row], MAX(qtd-1,MAX(difference, lastIRank[row]-1)));
                                 } else {
-                            #endif
-                                tij[row][lastIRank[row]]++;
-                                tij[row][qtd]++;
-                                tijMaxFreq[row] = MAX(tijMaxFreq[row], MAX(qtd,lastIRank[row]));
-                            #if COVERAGE
+                                    tij[row][lastIRank[row]]++;
+                                    tij[row][qtd]++;
+                                    tijMaxFreq[row] = MAX(tijMaxFreq[row], MAX(qtd,lastIRank[row]));
                                 }
-                            #endif
                             if(blocks == 1 && intervalEnd == readSize) 
                                 lastIRank[row] = 0;
                             else 
@@ -479,7 +622,8 @@ void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De){
 
         // update tij of lastIRank on last block
         if(blocks == 1){
-            for(i = 0; i < samples-1; i++){
+            for(g = 0; g < genomeCount; g++){
+                i = genomes[g];
                 for(j = i+1; j < samples; j++){
                     int row = (((j-1)*(j))/2)+i;
                     tij[row][lastIRank[row]]++;
@@ -487,12 +631,125 @@ void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De){
             }
         }
 
-        for(i = 0; i < samples; i++) rankbv_free(rbv[i]);
+        for(i = first; i < samples; i++) rankbv_free(rbv[i]);
         free(rbv);
 
         blocks--;
     }
 
+    free(lastJRank); free(lastIRank); free(iCoverage); free(jCoverage); free(coverage);
+}
+
+static void bwsdAllTermsColors(bossFile *boss, int mem, size_t **tij, size_t *tijMaxFreq, int *genomes, int genomeCount){
+    bwsdAllTerms(boss, mem, tij, tijMaxFreq, genomes, genomeCount, 0);
+}
+
+static void bwsdAllTermsCoverage(bossFile *boss, int mem, size_t **tij, size_t *tijMaxFreq, int *genomes, int genomeCount){
+    bwsdAllTerms(boss, mem, tij, tijMaxFreq, genomes, genomeCount, 1);
+}
+
+// indexed by runMode.coverage
+static void (*const bwsdAllTermsVariants[2])(bossFile*, int, size_t**, size_t*, int*, int) = { bwsdAllTermsColors, bwsdAllTermsCoverage };
+
+typedef struct {
+    bossFile *boss;
+    int mem;
+    size_t **tij;
+    size_t *tijMaxFreq;
+    int *genomes; // genomes i of the pairs (i, j) computed by this worker
+    int genomeCount;
+    double load;
+} bwsdAllWorker;
+
+static void* bwsdAllWorkerRun(void *arg){
+    bwsdAllWorker *w = (bwsdAllWorker*)arg;
+    if(w->genomeCount > 0)
+        bwsdAllTermsVariants[runMode.coverage](w->boss, w->mem, w->tij, w->tijMaxFreq, w->genomes, w->genomeCount);
+    return NULL;
+}
+
+/* Splits the genomes i < samples-1 among the workers, each one is given the
+   genome with the most work left to the least loaded worker. The work of i
+   is about its number of edges times the number of genomes j > i */
+static void bwsdAllAssign(bwsdAllWorker *workers, int threads, int samples, uint64_t *sampleEdges){
+    int i, t, g;
+    int *assigned = calloc(samples, sizeof(int));
+    for(g = 0; g < samples-1; g++){
+        int heaviest = -1;
+        for(i = 0; i < samples-1; i++){
+            if(!assigned[i] && (heaviest == -1 || (double)sampleEdges[i]*(samples-1-i) > (double)sampleEdges[heaviest]*(samples-1-heaviest)))
+                heaviest = i;
+        }
+        int lightest = 0;
+        for(t = 1; t < threads; t++){
+            if(workers[t].load < workers[lightest].load)
+                lightest = t;
+        }
+        assigned[heaviest] = 1;
+        workers[lightest].genomes[workers[lightest].genomeCount++] = heaviest;
+        workers[lightest].load += (double)(sampleEdges[heaviest]+1)*(samples-1-heaviest);
+    }
+    free(assigned);
+
+    // each worker computes its genomes in increasing order
+    for(t = 0; t < threads; t++){
+        for(g = 1; g < workers[t].genomeCount; g++){
+            int genome = workers[t].genomes[g];
+            for(i = g; i > 0 && workers[t].genomes[i-1] > genome; i--)
+                workers[t].genomes[i] = workers[t].genomes[i-1];
+            workers[t].genomes[i] = genome;
+        }
+    }
+}
+
+void bwsdAll(bossFile *boss, char* path, int mem, double** Dm, double** De, int threads){
+    size_t i, j, z;
+    int t;
+
+    // Count computation time
+    phaseMetrics metrics;
+    metricsStart(&metrics, "BWSD computation");
+    metrics.k = boss->header->k;
+
+    int samples = boss->header->samples;
+    int k = boss->header->k;
+    uint64_t *sampleSize = runMode.coverage ? boss->totalSampleCoverageInBoss : boss->totalSampleColorsInBoss;
+
+    int tijSize = ((samples*(samples-1))/2)+1;
+
+    size_t (**tij) = calloc(tijSize, sizeof(*tij));
+    for(i = 0; i < samples-1; i++){
+        for(j = i+1; j < samples; j++){
+            int row = (((j-1)*(j))/2)+i;
+            tij[row] = (size_t*) calloc(MAX(sampleSize[i],sampleSize[j])+2, sizeof(size_t));
+        }
+    } 
+    size_t *tijMaxFreq = calloc(tijSize, sizeof(size_t));
+
+    // each worker computes the pairs of its genomes over every block, in its own thread
+    threads = MAX(1, MIN(threads, samples-1));
+    bwsdAllWorker *workers = calloc(threads, sizeof(bwsdAllWorker));
+    pthread_t *ids = malloc(threads*sizeof(pthread_t));
+    for(t = 0; t < threads; t++){
+        workers[t].boss = boss;
+        workers[t].mem = mem;
+        workers[t].tij = tij;
+        workers[t].tijMaxFreq = tijMaxFreq;
+        workers[t].genomes = malloc(samples*sizeof(int));
+    }
+    bwsdAllAssign(workers, threads, samples, boss->totalSampleColorsInBoss);
+    for(t = 0; t < threads; t++){
+        if(threads == 1)
+            bwsdAllWorkerRun(&workers[t]);
+        else
+            pthread_create(&ids[t], NULL, bwsdAllWorkerRun, &workers[t]);
+    }
+    for(t = 0; t < threads && threads > 1; t++)
+        pthread_join(ids[t], NULL);
+    for(t = 0; t < threads; t++) free(workers[t].genomes);
+    free(workers);
+    free(ids);
+
     for(i = 0; i < samples-1; i++){
         for(j = i+1; j < samples; j++){
             int row = (((j-1)*(j))/2)+i;
@@ -505,37 +762,21 @@ void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De){
 
     FILE *infoFile = getInfoFile(path, NULL, k, 1);
 
-    #if DEBUG
-    printBWSDALLDebug(infoFile, path, samples, tijMaxFreq, tij);
-    #endif
+    if(runMode.debug)
+        printBWSDALLDebug(infoFile, path, samples, tijMaxFreq, tij);
 
-    endClock = clock();
+    metricsStop(&metrics);
 
-    cpuTimeUsed = ((double) (endClock - startClock)) / CLOCKS_PER_SEC;
+    printf("BWSD computation time: %lf seconds\n", metrics.wallTime);
 
-    printf("BWSD computation time: %lf seconds\n", cpuTimeUsed);
-
-    fprintf(infoFile, "BWSD computation time: %lf seconds\n", cpuTimeUsed);
+    metricsPrint(infoFile, &metrics);
     fclose(infoFile);
 
-    free(lastJRank); free(lastIRank); free(iCoverage); free(jCoverage);
-
     for(i = 0; i < tijSize; i++)
         free(tij[i]);
     free(tij); 
 
-    free(colors); free(coverage); free(summarizedLCP); free(summarizedSL); free(tijMaxFreq); 
-
-    free(info->totalSampleColorsInBoss);
-    free(info->totalSampleCoverageInBoss);
-    free(info);
-
-    fclose(colorsFile);
-    fclose(summarizedLCPFile);
-    fclose(summarizedSLFile);
-    fclose(coverageFile);
-
-    
+    free(tijMaxFreq); 
 
     return;
 }
@@ -557,3 +798,77 @@ void printBWSDALLDebug(FILE* infoFile, char* path, int samples, size_t* tijMaxFr
     }
     fprintf(infoFile, "\n");
 }
+
+bwsdNeighbors* bwsdNeighborsCreate(int genomes, int knn){
+    bwsdNeighbors *n = malloc(sizeof(bwsdNeighbors));
+    n->genomes = genomes;
+    n->knn = MAX(knn, 1);
+    n->count = calloc(genomes, sizeof(int));
+    n->heaps = malloc((size_t)genomes*n->knn*sizeof(bwsdNeighbor));
+    return n;
+}
+
+void bwsdNeighborsFree(bwsdNeighbors *n){
+    free(n->count);
+    free(n->heaps);
+    free(n);
+}
+
+// 1 if a is farther than b, by expectation, then entropy and genome
+static int bwsdNeighborFarther(bwsdNeighbor *a, bwsdNeighbor *b){
+    if(a->expectation != b->expectation)
+        return a->expectation > b->expectation;
+    if(a->entropy != b->entropy)
+        return a->entropy > b->entropy;
+    return a->genome > b->genome;
+}
+
+// Adds other to the max heap of genome, the farthest neighbor at its root
+static void bwsdNeighborsPush(bwsdNeighbors *n, int genome, bwsdNeighbor *other){
+    bwsdNeighbor *heap = &n->heaps[(size_t)genome*n->knn];
+    int i, count = n->count[genome];
+    if(count == n->knn){
+        if(!bwsdNeighborFarther(&heap[0], other))
+            return;
+        // the farthest one is replaced, and sifted down
+        i = 0;
+        while(2*i+1 < count){
+            int child = 2*i+1;
+            if(child+1 < count && bwsdNeighborFarther(&heap[child+1], &heap[child]))
+                child++;
+            if(!bwsdNeighborFarther(&heap[child], other))
+                break;
+            heap[i] = heap[child];
+            i = child;
+        }
+        heap[i] = *other;
+        return;
+    }
+    for(i = count; i > 0 && bwsdNeighborFarther(other, &heap[(i-1)/2]); i = (i-1)/2)
+        heap[i] = heap[(i-1)/2];
+    heap[i] = *other;
+    n->count[genome]++;
+}
+
+void bwsdNeighborsAdd(bwsdNeighbors *n, int genome1, int genome2, double expectation, double entropy){
+    bwsdNeighbor neighbor = { genome2, expectation, entropy };
+    bwsdNeighborsPush(n, genome1, &neighbor);
+    neighbor.genome = genome1;
+    bwsdNeighborsPush(n, genome2, &neighbor);
+}
+
+double bwsdNeighborsBound(bwsdNeighbors *n, int genome1, int genome2){
+    if(n->count[genome1] < n->knn || n->count[genome2] < n->knn)
+        return INFINITY;
+    return MAX(n->heaps[(size_t)genome1*n->knn].expectation, n->heaps[(size_t)genome2*n->knn].expectation);
+}
+
+static int compareNeighbors(const void *a, const void *b){
+    bwsdNeighbor *x = (bwsdNeighbor*)a, *y = (bwsdNeighbor*)b;
+    return bwsdNeighborFarther(x, y) - bwsdNeighborFarther(y, x);
+}
+
+void bwsdNeighborsSort(bwsdNeighbors *n){
+    for(int g = 0; g < n->genomes; g++)
+        qsort(&n->heaps[(size_t)g*n->knn], n->count[g], sizeof(bwsdNeighbor), compareNeighbors);
+}
@@ -1,12 +1,66 @@
+#ifndef BWSD_H
+#define BWSD_H
 
-void bwsd(char* file1, char* file2, int k, double *expectation, double *entropy, int mem, int printBoss, int consider1, int consider2);
+#include "bossfile.h"
 
-void bwsdAll(char* path, int samples, int k, int mem, double** Dm, double** De);
+/* Nearest genomes of each genome by BWSD expectation, in a max heap of up
+   to knn neighbors per genome, so the farthest one is replaced in O(log knn)
+ */
+typedef struct {
+    int genome;
+    double expectation, entropy;
+} bwsdNeighbor;
 
-void applyCoverageMerge(int zeroCoverage, int oneCoverage, size_t *rlFreq, size_t *pos);
+typedef struct {
+    int genomes, knn;
+    int *count;
+    bwsdNeighbor *heaps; // of genome g, heaps[g*knn..g*knn+count[g]-1]
+} bwsdNeighbors;
+
+bwsdNeighbors* bwsdNeighborsCreate(int genomes, int knn);
+
+void bwsdNeighborsFree(bwsdNeighbors *n);
+
+// Adds the pair to the neighbors of both genomes, if it is nearer than their farthest one
+void bwsdNeighborsAdd(bwsdNeighbors *n, int genome1, int genome2, double expectation, double entropy);
+
+// Expectation a pair must be below to be a neighbor of genome1 or genome2, INFINITY while either has less than knn
+double bwsdNeighborsBound(bwsdNeighbors *n, int genome1, int genome2);
+
+// Sorts the neighbors of each genome, the nearest first
+void bwsdNeighborsSort(bwsdNeighbors *n);
+
+/* BWSD between genomes consider1 and consider2 of a BOSS file. Without
+   coverage, it stops once its expectation is sure to be larger than bound
+   (INFINITY to never stop), then it returns 1 and both values are NAN */
+int bwsd(bossFile *boss, char* file1, char* file2, double *expectation, double *entropy, int mem, int printBoss, int consider1, int consider2, double bound);
+
+/* BWSD of pairCount pairs of genomes (pairs[2*p], pairs[2*p+1]) of a BOSS
+   file, with the same terms as bwsd. The BOSS is scanned once per batch of
+   pairs, instead of once per pair. If neighbors is not NULL, each pair is
+   added to it, and the pairs that can not get into the neighbors of either
+   genome of them (bwsdNeighborsBound as of the previous batches) stop early,
+   with NAN values. The first knn pairs of each genome are computed first to
+   fill the neighbors, so pairs should go from the likely nearest ones
+ */
+void bwsdPairs(bossFile *boss, char* path, int *pairs, int pairCount, double *expectation, double *entropy, bwsdNeighbors *neighbors);
+
+// BWSD between all pairs of genomes of a BOSS file, the pairs of each genome are computed by one of threads threads
+void bwsdAll(bossFile *boss, char* path, int mem, double** Dm, double** De, int threads);
+
+void printBWSDDebug(FILE* infoFile, char* file1, char* file2, size_t totalCoverage, size_t n, size_t pos, size_t s, size_t maxFreq, size_t* t, short* genome0, short* genome1);
+
+void printBWSDALLDebug(FILE* infoFile, char* path, int samples, size_t* tijMaxFreq,size_t** tij);
+
+// Run lengths of a pair of genomes along a BOSS
+typedef struct bwsdPair bwsdPair;
+
+void applyCoverageMerge(int zeroCoverage, int oneCoverage, bwsdPair *pair);
 
 double bwsdExpectation(size_t *t, size_t s, size_t n);
 
 double bwsdShannonEntropy(size_t *t, size_t s, size_t n);
 
-double log2(double i);
\ No newline at end of file
+double log2(double i);
+
+#endif
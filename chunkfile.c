@@ -0,0 +1,230 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <zlib.h>
+#include "chunkfile.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+struct chunkReader {
+    FILE *f;
+    char *fileName;
+    int compressed; // 0 for a file read as it is
+
+    chunkFileHeader header;
+    uint64_t *offsets;
+    unsigned char *input; // compressed chunk being decompressed by the worker
+
+    // chunk c is decompressed to slots[c % CHUNK_FILE_AHEAD]
+    unsigned char *slots[CHUNK_FILE_AHEAD];
+    size_t slotLength[CHUNK_FILE_AHEAD];
+    uint64_t current; // chunk being read
+    size_t position; // in the current chunk
+    uint64_t filled; // chunks before it are decompressed
+    int stop;
+
+    pthread_t worker;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+};
+
+static int readHeader(FILE *f, chunkFileHeader *header){
+    return fread(header, sizeof(chunkFileHeader), 1, f) == 1 && memcmp(header->magic, CHUNK_FILE_MAGIC, 8) == 0 && header->version == CHUNK_FILE_VERSION;
+}
+
+int chunkFileCompress(char *inputName, char *outputName, int level){
+    chunkFileHeader header;
+    uint64_t capacity = 64, offset;
+    int status = 0;
+
+    FILE *input = fopen(inputName, "rb");
+    FILE *output = input != NULL ? fopen(outputName, "wb") : NULL;
+    if(output == NULL){
+        if(input != NULL) fclose(input);
+        return -1;
+    }
+
+    memset(&header, 0, sizeof(chunkFileHeader));
+    memcpy(header.magic, CHUNK_FILE_MAGIC, 8);
+    header.version = CHUNK_FILE_VERSION;
+    header.chunkSize = CHUNK_FILE_SIZE;
+    fwrite(&header, sizeof(chunkFileHeader), 1, output);
+
+    uLong bound = compressBound(CHUNK_FILE_SIZE);
+    unsigned char *chunk = malloc(CHUNK_FILE_SIZE);
+    unsigned char *compressed = malloc(bound);
+    uint64_t *offsets = malloc(capacity*sizeof(uint64_t));
+    offset = sizeof(chunkFileHeader);
+
+    size_t read;
+    while(status == 0 && (read = fread(chunk, 1, CHUNK_FILE_SIZE, input)) > 0){
+        uLongf length = bound;
+        if(compress2(compressed, &length, chunk, read, level) != Z_OK || fwrite(compressed, 1, length, output) != length){
+            status = -1;
+            break;
+        }
+        if(header.chunks+1 == capacity){
+            capacity *= 2;
+            offsets = realloc(offsets, capacity*sizeof(uint64_t));
+        }
+        offsets[header.chunks++] = offset;
+        offset += length;
+        header.length += read;
+    }
+    offsets[header.chunks] = offset;
+    header.indexOffset = offset;
+
+    if(status == 0 && fwrite(offsets, sizeof(uint64_t), header.chunks+1, output) != header.chunks+1)
+        status = -1;
+    if(status == 0 && (fseek(output, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(chunkFileHeader), 1, output) != 1))
+        status = -1;
+
+    fclose(input);
+    if(fclose(output) != 0)
+        status = -1;
+    free(chunk);
+    free(compressed);
+    free(offsets);
+    return status;
+}
+
+long chunkFileLength(char *fileName){
+    chunkFileHeader header;
+    FILE *f = fopen(fileName, "rb");
+    if(f == NULL)
+        return -1;
+    long length;
+    if(readHeader(f, &header)){
+        length = header.length;
+    } else {
+        fseek(f, 0, SEEK_END);
+        length = ftell(f);
+    }
+    fclose(f);
+    return length;
+}
+
+static size_t chunkLength(chunkReader *r, uint64_t chunk){
+    return MIN((uint64_t)r->header.chunkSize, r->header.length - chunk*r->header.chunkSize);
+}
+
+// Decompresses the chunks from the first one read on, up to CHUNK_FILE_AHEAD of them ahead of the reader
+static void* decompressChunks(void *arg){
+    chunkReader *r = (chunkReader*)arg;
+
+    pthread_mutex_lock(&r->lock);
+    while(!r->stop && r->filled < r->header.chunks){
+        if(r->filled - r->current >= CHUNK_FILE_AHEAD){
+            pthread_cond_wait(&r->changed, &r->lock);
+            continue;
+        }
+        uint64_t chunk = r->filled;
+        pthread_mutex_unlock(&r->lock);
+
+        int slot = chunk % CHUNK_FILE_AHEAD;
+        size_t compressed = r->offsets[chunk+1] - r->offsets[chunk];
+        uLongf length = chunkLength(r, chunk);
+        if(fseek(r->f, r->offsets[chunk], SEEK_SET) != 0 || fread(r->input, 1, compressed, r->f) != compressed ||
+           uncompress(r->slots[slot], &length, r->input, compressed) != Z_OK || length != chunkLength(r, chunk)){
+            fprintf(stderr, "Unable to decompress file %s\n", r->fileName);
+            exit(-1);
+        }
+
+        pthread_mutex_lock(&r->lock);
+        r->slotLength[slot] = length;
+        r->filled++;
+        pthread_cond_broadcast(&r->changed);
+    }
+    pthread_mutex_unlock(&r->lock);
+    return NULL;
+}
+
+chunkReader* chunkReaderOpen(char *fileName, size_t offset){
+    int i;
+    FILE *f = fopen(fileName, "rb");
+    if(f == NULL)
+        return NULL;
+
+    chunkReader *r = calloc(1, sizeof(chunkReader));
+    r->f = f;
+    r->fileName = strdup(fileName);
+    if(!readHeader(f, &r->header)){
+        fseek(f, offset, SEEK_SET);
+        return r;
+    }
+
+    r->compressed = 1;
+    r->offsets = malloc((r->header.chunks+1)*sizeof(uint64_t));
+    if(fseek(f, r->header.indexOffset, SEEK_SET) != 0 || fread(r->offsets, sizeof(uint64_t), r->header.chunks+1, f) != r->header.chunks+1){
+        fprintf(stderr, "Unable to read file %s\n", fileName);
+        exit(-1);
+    }
+    r->input = malloc(compressBound(r->header.chunkSize));
+    for(i = 0; i < CHUNK_FILE_AHEAD; i++)
+        r->slots[i] = malloc(r->header.chunkSize);
+
+    // past the end nothing is decompressed
+    if(offset < r->header.length){
+        r->current = r->filled = offset/r->header.chunkSize;
+        r->position = offset%r->header.chunkSize;
+    } else {
+        r->current = r->filled = r->header.chunks;
+    }
+
+    pthread_mutex_init(&r->lock, NULL);
+    pthread_cond_init(&r->changed, NULL);
+    pthread_create(&r->worker, NULL, decompressChunks, r);
+    return r;
+}
+
+size_t chunkReaderRead(void *data, size_t size, size_t count, chunkReader *r){
+    if(!r->compressed)
+        return fread(data, size, count, r->f);
+
+    unsigned char *output = (unsigned char*)data;
+    size_t bytes = 0, total = size*count;
+    while(bytes < total && r->current < r->header.chunks){
+        pthread_mutex_lock(&r->lock);
+        while(r->filled <= r->current)
+            pthread_cond_wait(&r->changed, &r->lock);
+        pthread_mutex_unlock(&r->lock);
+
+        int slot = r->current % CHUNK_FILE_AHEAD;
+        size_t copied = MIN(r->slotLength[slot] - r->position, total - bytes);
+        memcpy(output + bytes, r->slots[slot] + r->position, copied);
+        bytes += copied;
+        r->position += copied;
+
+        // the slot of a chunk read to its end goes to the worker
+        if(r->position == r->slotLength[slot]){
+            pthread_mutex_lock(&r->lock);
+            r->current++;
+            r->position = 0;
+            pthread_cond_broadcast(&r->changed);
+            pthread_mutex_unlock(&r->lock);
+        }
+    }
+    return bytes/size;
+}
+
+void chunkReaderClose(chunkReader *r){
+    int i;
+    if(r->compressed){
+        pthread_mutex_lock(&r->lock);
+        r->stop = 1;
+        pthread_cond_broadcast(&r->changed);
+        pthread_mutex_unlock(&r->lock);
+        pthread_join(r->worker, NULL);
+        pthread_mutex_destroy(&r->lock);
+        pthread_cond_destroy(&r->changed);
+
+        for(i = 0; i < CHUNK_FILE_AHEAD; i++)
+            free(r->slots[i]);
+        free(r->input);
+        free(r->offsets);
+    }
+    fclose(r->f);
+    free(r->fileName);
+    free(r);
+}
@@ -0,0 +1,50 @@
+#ifndef CHUNKFILE_H
+#define CHUNKFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/* Chunk file layout (native byte order):
+     chunkFileHeader
+     chunks, each one CHUNK_FILE_SIZE bytes (the last one may be shorter)
+     compressed on its own with zlib
+     uint64_t offsets[chunks+1], of each chunk and of the end of the last one
+   so it can be read from any position by decompressing from its chunk on.
+ */
+
+#define CHUNK_FILE_MAGIC "GCBBCHNK"
+#define CHUNK_FILE_VERSION 1
+#define CHUNK_FILE_SIZE (2 << 20)
+
+// chunks decompressed ahead of the reader
+#define CHUNK_FILE_AHEAD 2
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t chunkSize; // uncompressed bytes of a chunk
+    uint64_t length; // uncompressed bytes
+    uint64_t chunks;
+    uint64_t indexOffset; // of offsets
+} chunkFileHeader;
+
+/* Writes the bytes of inputName to outputName as a chunk file compressed
+   with zlib level (1 to 9), returns 0 on success */
+int chunkFileCompress(char *inputName, char *outputName, int level);
+
+// Uncompressed bytes of fileName, a chunk file or not. -1 if it can not be read
+long chunkFileLength(char *fileName);
+
+typedef struct chunkReader chunkReader;
+
+/* Opens fileName to read from byte offset on. A chunk file is decompressed
+   by a thread of the reader, CHUNK_FILE_AHEAD chunks ahead of it, and any
+   other file is read as it is. Returns NULL if it can not be read */
+chunkReader* chunkReaderOpen(char *fileName, size_t offset);
+
+// Reads up to count elements of size bytes, like fread
+size_t chunkReaderRead(void *data, size_t size, size_t count, chunkReader *r);
+
+void chunkReaderClose(chunkReader *r);
+
+#endif
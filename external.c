@@ -5,26 +5,186 @@
 #include <dirent.h>
 #include <unistd.h>
 #include <libgen.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "external.h"
+#include "input.h"
+#include "metrics.h"
+#include "manifest.h"
+#include "chunkfile.h"
+#include "sketch.h"
 
 #define FILE_PATH 1024
 
+#ifndef COVERAGE
+	#define COVERAGE 0
+#endif
+
+#ifndef ALL_VS_ALL
+	#define ALL_VS_ALL 0
+#endif
+
+#ifndef DEBUG
+	#define DEBUG 0
+#endif
+
+#ifndef MERGE_FANIN
+	#define MERGE_FANIN 32
+#endif
+
+// merges of the inputs have 1 byte genome ids
+#if MERGE_FANIN < 2 || MERGE_FANIN > 256
+	#error MERGE_FANIN must be between 2 and 256
+#endif
+
+// values of the merged LCP and SL capped at a time
+#define CAP_BUFFER (1 << 20)
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+// make options are the defaults, main may change them with -a, -c and -d
+gcbbMode runMode = { ALL_VS_ALL, COVERAGE, DEBUG };
+
+// main may change them with --tmp-dir and --out-dir
+char *tmpDir = "tmp";
+char *outDir = "results";
+
+int mergeCompression[MERGE_ARRAYS] = { 0, 0, 0, 0 };
+
+const char *mergeArrayNames[MERGE_ARRAYS] = { "bwt", "da", "lcp", "sl" };
+
+int makeDirectory(char *path){
+    char directory[FILE_PATH];
+    snprintf(directory, FILE_PATH, "%s", path);
+    // parents first, like mkdir -p
+    for(char *slash = strchr(directory+1, '/'); slash != NULL; slash = strchr(slash+1, '/')){
+        *slash = '\0';
+        if(mkdir(directory, 0777) != 0 && errno != EEXIST)
+            return -1;
+        *slash = '/';
+    }
+    if(mkdir(directory, 0777) != 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
 void computeNewickFiles(char *dmat){
     char dmat_newick[FILE_PATH];
 
-    char *ptr = strchr(dmat, '.');
+    // the directories may have dots too
+    char *ptr = strrchr(dmat, '.');
     if (ptr != NULL)
         *ptr = '\0';
 
     snprintf(dmat_newick, FILE_PATH, "utils/nj -i %s.dmat -n %s.nhx", dmat, dmat);
 
-    int systemCall = system(dmat_newick);
+    int systemCall = metricsSystem(dmat_newick);
     if(systemCall == -1){
         printf("Error during newick file computation");
     }
 }
 
-void computeFile(char *path, char *file, int memory){
+// the eGap executable is part of the key of every array it computes
+static uint64_t eGapHash(){
+    static uint64_t hash = 0;
+    if(hash == 0)
+        hash = manifestHashFile("egap/eGap");
+    return hash;
+}
+
+static int eGapSucceeded(int status){
+    return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// The arrays of <tmpDir>/<name> are valid if every file eGap wrote for them was committed with key
+static int eGapOutputsValid(char *name, uint64_t key){
+    char prefix[FILE_PATH];
+    char extensions[FILE_PATH];
+    char fileName[2*FILE_PATH];
+    snprintf(prefix, FILE_PATH, "%s/%s", tmpDir, name);
+    if(!manifestValue(prefix, key, extensions, FILE_PATH))
+        return 0;
+    for(char *extension = strtok(extensions, ","); extension != NULL; extension = strtok(NULL, ",")){
+        snprintf(fileName, 2*FILE_PATH, "%s.%s", prefix, extension);
+        if(!manifestValid(fileName, key))
+            return 0;
+    }
+    return 1;
+}
+
+// Renames every <tmpDir>/<name>.part.<extension> written by eGap to <tmpDir>/<name>.<extension> and commits them with key
+static int commitEGapOutputs(char *name, uint64_t key){
+    char partPrefix[FILE_PATH];
+    char prefix[FILE_PATH];
+    char extensions[FILE_PATH] = "";
+    char partName[2*FILE_PATH];
+    char fileName[2*FILE_PATH];
+    snprintf(partPrefix, FILE_PATH, "%s.part.", name);
+    snprintf(prefix, FILE_PATH, "%s/%s", tmpDir, name);
+    int partPrefixLen = strlen(partPrefix);
+
+    // collected first, so renamed files are not found again by readdir
+    DIR *tmp = opendir(tmpDir);
+    struct dirent *entry;
+    if(tmp == NULL)
+        return -1;
+    while((entry = readdir(tmp)) != NULL){
+        if(strncmp(entry->d_name, partPrefix, partPrefixLen) == 0 && strlen(extensions)+strlen(entry->d_name+partPrefixLen)+2 < FILE_PATH){
+            if(extensions[0] != '\0')
+                strcat(extensions, ",");
+            strcat(extensions, entry->d_name+partPrefixLen);
+        }
+    }
+    closedir(tmp);
+    if(extensions[0] == '\0')
+        return -1;
+
+    char committed[FILE_PATH];
+    strcpy(committed, extensions);
+    for(char *extension = strtok(committed, ","); extension != NULL; extension = strtok(NULL, ",")){
+        snprintf(partName, 2*FILE_PATH, "%s/%s%s", tmpDir, partPrefix, extension);
+        snprintf(fileName, 2*FILE_PATH, "%s.%s", prefix, extension);
+        if(manifestCommit(partName, fileName, key) != 0)
+            return -1;
+    }
+    manifestSetValue(prefix, key, extensions);
+    return 0;
+}
+
+void removeEGapOutputs(char *name, uint64_t key){
+    char prefix[FILE_PATH];
+    char extensions[FILE_PATH];
+    char fileName[2*FILE_PATH];
+    snprintf(prefix, FILE_PATH, "%s/%s", tmpDir, name);
+    if(!manifestValue(prefix, key, extensions, FILE_PATH))
+        return;
+    for(char *extension = strtok(extensions, ","); extension != NULL; extension = strtok(NULL, ",")){
+        snprintf(fileName, 2*FILE_PATH, "%s.%s", prefix, extension);
+        remove(fileName);
+    }
+}
+
+uint64_t fileKey(char *path, char *file){
+    // the arrays only depend on the content of the input, -m just changes how eGap computes them
+    char input[FILE_PATH];
+    snprintf(input, FILE_PATH, "%s%s", path, file);
+    return manifestKey("eGap %016lx input %016lx", eGapHash(), manifestHashFile(input));
+}
+
+uint64_t mergeFileAllKey(uint64_t *fileKeys, int numberOfFiles){
+    uint64_t key = manifestKey("eGap %016lx merge cap %d", eGapHash(), MERGE_LCP_MAX);
+    for(int i = 0; i < numberOfFiles; i++)
+        key = manifestKey("%016lx %016lx", key, fileKeys[i]);
+    return key;
+}
+
+uint64_t mergeFilesKey(uint64_t key1, uint64_t key2){
+    return manifestKey("eGap %016lx merge --rev %016lx %016lx cap %d", eGapHash(), key1, key2, MERGE_LCP_MAX);
+}
+
+void computeFile(char *path, char *file, uint64_t key, int memory){
     int len = strlen(file);
     char buff[len+1];
     strncpy(buff, file, len+1); 
@@ -33,62 +193,318 @@ void computeFile(char *path, char *file, int memory){
     if(ptr != NULL)
         *ptr = '\0';
 
-    char output[len+8];
-    snprintf(output, len+8, "tmp/%s.bwt", file);
-    FILE *tmp = fopen(output, "r");
-    if(!tmp){
-        char eGap[FILE_PATH];
-        snprintf(eGap, FILE_PATH, "egap/eGap %s%s -m %d --em --rev --lcp  --sl --slbytes 2 -o tmp/%s", path, buff, memory, file);
-        int systemCall = system(eGap);
-        if(systemCall == -1){
+    if(!eGapOutputsValid(file, key)){
+        // stream (and decompress) the input into a normalized FASTA read by eGap
+        char input[FILE_PATH];
+        char normalized[FILE_PATH];
+        snprintf(input, FILE_PATH, "%s%s", path, buff);
+        snprintf(normalized, FILE_PATH, "%s/%s.fasta", tmpDir, file);
+        size_t reads = normalizeSequenceFile(input, normalized);
+        printf("%s: %zu reads normalized\n", file, reads);
+
+        char eGap[3*FILE_PATH];
+        snprintf(eGap, 3*FILE_PATH, "egap/eGap %s -m %d --em --rev --lcp  --sl --slbytes 2 -o %s/%s.part", normalized, memory, tmpDir, file);
+        int systemCall = metricsSystem(eGap);
+        if(!eGapSucceeded(systemCall) || commitEGapOutputs(file, key) != 0){
             printf("Error during eGap compute file");
         }
+        remove(normalized);
     } else {
         printf("%s files already computed!\n", file);
-        fclose(tmp);
     }
 }
 
-void computeMergeFileAll(char *path, char **files, int numberOfFiles, int memory){
-    char output[strlen(path)+14];
-    snprintf(output, strlen(path)+14, "tmp/merge.%s.bwt", path);
-    FILE *tmp = fopen(output, "r");
-    if(!tmp){
-        char eGapMerge[FILE_PATH];
-        snprintf(eGapMerge, FILE_PATH, "egap/eGap -m %d --em --bwt --lcp --cda --cbytes 1 --sl --slbytes 2 ", memory);
-        for(int i = 0; i < numberOfFiles; i++){
-            int bufferLen = strlen(eGapMerge) + strlen(files[i]) + 9;
-            snprintf(eGapMerge + strlen(eGapMerge), bufferLen, "tmp/%s.bwt ", files[i]);
+sketch* computeSketch(char *path, char *file, int kmer){
+    char input[FILE_PATH];
+    char name[FILE_PATH];
+    char sketchFileName[2*FILE_PATH];
+    char partName[2*FILE_PATH];
+    snprintf(input, FILE_PATH, "%s%s", path, file);
+    snprintf(name, FILE_PATH, "%s", file);
+    char *ptr = strchr(name, '.');
+    if(ptr != NULL)
+        *ptr = '\0';
+    snprintf(sketchFileName, 2*FILE_PATH, "%s/%s.%d.sketch", tmpDir, name, kmer);
+    snprintf(partName, 2*FILE_PATH, "%s/%s.%d.sketch.part", tmpDir, name, kmer);
+
+    // the sketch only depends on the content of the input
+    uint64_t key = manifestKey("sketch input %016lx kmer %d size %d", manifestHashFile(input), kmer, SKETCH_SIZE);
+    sketch *s = manifestValid(sketchFileName, key) ? sketchRead(sketchFileName) : NULL;
+    if(s != NULL)
+        return s;
+
+    s = sketchSequenceFile(input, kmer);
+    if(sketchWrite(s, partName) != 0 || manifestCommit(partName, sketchFileName, key) != 0)
+        fprintf(stderr, "Unable to write file %s\n", sketchFileName);
+    return s;
+}
+
+// Node of the merge tree of computeMergeFileAll, the leaves are the arrays of the inputs
+typedef struct {
+    char name[FILE_PATH];
+    uint64_t key;
+    int first, count; // genomes of the node
+    int firstChild, children; // nodes of the previous level
+    int needed;
+} mergeNode;
+
+// DA bytes of a merge of count genomes, with the genome ids relative to its first genome
+static int mergeDABytes(int count){
+    return count > 256 ? 2 : 1;
+}
+
+static int readGenomeId(FILE *f, int bytes){
+    unsigned char id[2] = {0, 0};
+    if(fread(id, 1, bytes, f) != (size_t)bytes)
+        return -1;
+    return bytes == 1 ? id[0] : id[0] | id[1] << 8;
+}
+
+static void writeGenomeId(FILE *f, int id, int bytes){
+    unsigned char value[2] = {id & 0xff, id >> 8};
+    fwrite(value, 1, bytes, f);
+}
+
+/* The DA written by eGap for a merge of merges has the position of the
+   merge each suffix comes from. Since merging keeps the order of the
+   suffixes of each input, the r-th suffix from child c is the r-th suffix
+   in the DA of c, so the DA of the children gives its genome */
+static int remapDA(mergeNode *node, mergeNode *children){
+    int c, id;
+    char fileName[2*FILE_PATH];
+    char remapped[2*FILE_PATH];
+    int bytes = mergeDABytes(node->count);
+
+    FILE **childDA = malloc(node->children*sizeof(FILE*));
+    for(c = 0; c < node->children; c++){
+        snprintf(fileName, 2*FILE_PATH, "%s/%s.%d.cda", tmpDir, children[c].name, mergeDABytes(children[c].count));
+        childDA[c] = fopen(fileName, "rb");
+        if(childDA[c] == NULL){
+            fprintf(stderr, "Unable to read file %s\n", fileName);
+            exit(-1);
         }
-        snprintf(eGapMerge + strlen(eGapMerge), strlen(eGapMerge)+strlen(path)+13, "-o tmp/merge.%s", path);
-        printf("%s\n", eGapMerge);
-        int systemCall = system(eGapMerge);
-        if(systemCall == -1){
-            printf("Error during eGap merge files");
+    }
+
+    snprintf(fileName, 2*FILE_PATH, "%s/%s.part.1.cda", tmpDir, node->name);
+    snprintf(remapped, 2*FILE_PATH, "%s/%s.part.%d.cda.remap", tmpDir, node->name, bytes);
+    FILE *da = fopen(fileName, "rb");
+    FILE *output = fopen(remapped, "wb");
+    if(da == NULL || output == NULL){
+        fprintf(stderr, "Unable to remap file %s\n", fileName);
+        exit(-1);
+    }
+
+    int status = 0;
+    while((c = getc(da)) != EOF){
+        if(c >= node->children || (id = readGenomeId(childDA[c], mergeDABytes(children[c].count))) < 0){
+            status = -1;
+            break;
         }
-    } else {
+        writeGenomeId(output, children[c].first - node->first + id, bytes);
+    }
+
+    fclose(da);
+    if(fclose(output) != 0)
+        status = -1;
+    for(c = 0; c < node->children; c++)
+        fclose(childDA[c]);
+    free(childDA);
+
+    if(status == 0){
+        remove(fileName);
+        snprintf(fileName, 2*FILE_PATH, "%s/%s.part.%d.cda", tmpDir, node->name, bytes);
+        status = rename(remapped, fileName);
+    }
+    return status;
+}
+
+/* Replaces the 2 bytes LCP and SL written by eGap for the merge <name>
+   with 1 byte ones (.part.1.lcp and .part.1.sl) capped to MERGE_LCP_MAX */
+static int capMergeArrays(char *name){
+    const char *arrays[2] = { "lcp", "sl" };
+    char fileName[2*FILE_PATH];
+    char capped[2*FILE_PATH];
+    uint16_t *values = malloc(CAP_BUFFER*sizeof(uint16_t));
+    unsigned char *bytes = malloc(CAP_BUFFER);
+    size_t read, j;
+    int a, status = 0;
+
+    for(a = 0; a < 2 && status == 0; a++){
+        snprintf(fileName, 2*FILE_PATH, "%s/%s.part.2.%s", tmpDir, name, arrays[a]);
+        snprintf(capped, 2*FILE_PATH, "%s/%s.part.1.%s", tmpDir, name, arrays[a]);
+        FILE *input = fopen(fileName, "rb");
+        FILE *output = input != NULL ? fopen(capped, "wb") : NULL;
+        if(output == NULL){
+            fprintf(stderr, "Unable to cap file %s\n", fileName);
+            if(input != NULL) fclose(input);
+            status = -1;
+            break;
+        }
+        while((read = fread(values, sizeof(uint16_t), CAP_BUFFER, input)) > 0){
+            for(j = 0; j < read; j++) bytes[j] = MIN(values[j], MERGE_LCP_MAX);
+            fwrite(bytes, 1, read, output);
+        }
+        fclose(input);
+        if(fclose(output) != 0)
+            status = -1;
+        else
+            remove(fileName);
+    }
+
+    free(values);
+    free(bytes);
+    return status;
+}
+
+/* Replaces the arrays of the merge <name> read by the BOSS construction
+   with chunk files, compressed with the mergeCompression level of each */
+static int compressMergeArrays(char *name, int daBytes){
+    char extensions[MERGE_ARRAYS][16];
+    char fileName[2*FILE_PATH];
+    char compressed[2*FILE_PATH];
+    int a;
+
+    snprintf(extensions[MERGE_BWT], 16, "bwt");
+    snprintf(extensions[MERGE_DA], 16, "%d.cda", daBytes);
+    snprintf(extensions[MERGE_LCP], 16, "1.lcp");
+    snprintf(extensions[MERGE_SL], 16, "1.sl");
+    for(a = 0; a < MERGE_ARRAYS; a++){
+        if(mergeCompression[a] == 0)
+            continue;
+        snprintf(fileName, 2*FILE_PATH, "%s/%s.part.%s", tmpDir, name, extensions[a]);
+        snprintf(compressed, 2*FILE_PATH, "%s/%s.part.%s.chunks", tmpDir, name, extensions[a]);
+        if(chunkFileCompress(fileName, compressed, mergeCompression[a]) != 0 || rename(compressed, fileName) != 0){
+            fprintf(stderr, "Unable to compress file %s\n", fileName);
+            remove(compressed);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void computeMergeFileAll(char *path, char **files, uint64_t *fileKeys, uint64_t key, int numberOfFiles, int memory, int threads, int keepTmp){
+    int i, c, level;
+
+    // levels of the tree above the inputs, each node merges up to MERGE_FANIN nodes of the level below
+    int levels = 1;
+    for(int nodes = numberOfFiles; nodes > MERGE_FANIN; nodes = (nodes + MERGE_FANIN - 1)/MERGE_FANIN)
+        levels++;
+    mergeNode **tree = malloc((levels+1)*sizeof(mergeNode*));
+    int *width = malloc((levels+1)*sizeof(int));
+
+    tree[0] = calloc(numberOfFiles, sizeof(mergeNode));
+    width[0] = numberOfFiles;
+    for(i = 0; i < numberOfFiles; i++){
+        snprintf(tree[0][i].name, FILE_PATH, "%s", files[i]);
+        tree[0][i].key = fileKeys[i];
+        tree[0][i].first = i;
+        tree[0][i].count = 1;
+    }
+    for(level = 1; level <= levels; level++){
+        width[level] = (width[level-1] + MERGE_FANIN - 1)/MERGE_FANIN;
+        tree[level] = calloc(width[level], sizeof(mergeNode));
+        for(i = 0; i < width[level]; i++){
+            mergeNode *node = &tree[level][i];
+            node->firstChild = i*MERGE_FANIN;
+            node->children = MIN(MERGE_FANIN, width[level-1] - node->firstChild);
+            mergeNode *last = &tree[level-1][node->firstChild + node->children - 1];
+            node->first = tree[level-1][node->firstChild].first;
+            node->count = last->first + last->count - node->first;
+            if(level == levels){
+                // the root is the merge of every input, whatever the shape of the tree
+                snprintf(node->name, FILE_PATH, "merge.%s", path);
+                node->key = key;
+            } else {
+                snprintf(node->name, FILE_PATH, "merge.%s.%d.%d", path, level, i);
+                node->key = manifestKey("eGap %016lx merge level %d", eGapHash(), level);
+                for(c = 0; c < node->children; c++)
+                    node->key = manifestKey("%016lx %016lx", node->key, tree[level-1][node->firstChild+c].key);
+            }
+        }
+    }
+
+    // a merge is needed if it is not computed yet and the merge above it is needed
+    tree[levels][0].needed = !eGapOutputsValid(tree[levels][0].name, key);
+    for(level = levels; level > 1; level--){
+        for(i = 0; i < width[level]; i++){
+            mergeNode *node = &tree[level][i];
+            for(c = 0; c < node->children && node->needed; c++){
+                mergeNode *child = &tree[level-1][node->firstChild+c];
+                child->needed = !eGapOutputsValid(child->name, child->key);
+            }
+        }
+    }
+    if(!tree[levels][0].needed)
         printf("%s merge file already computed!\n", path);
-        fclose(tmp);
+
+    // the merges of each level run in parallel, sharing the memory
+    char **commands = malloc(width[1]*sizeof(char*));
+    int *statuses = malloc(width[1]*sizeof(int));
+    mergeNode **running = malloc(width[1]*sizeof(mergeNode*));
+    for(level = 1; level <= levels; level++){
+        int count = 0;
+        for(i = 0; i < width[level]; i++){
+            if(tree[level][i].needed)
+                running[count++] = &tree[level][i];
+        }
+        if(count == 0)
+            continue;
+        int parallel = MIN(count, MAX(threads, 1));
+        int nodeMemory = MAX(memory/parallel, 1);
+
+        for(i = 0; i < count; i++){
+            mergeNode *node = running[i];
+            // every input is in the command, with the tmp directory
+            size_t size = FILE_PATH + strlen(tmpDir) + strlen(node->name);
+            for(c = 0; c < node->children; c++)
+                size += strlen(tmpDir) + strlen(tree[level-1][node->firstChild+c].name) + 6;
+            commands[i] = malloc(size);
+            size_t len = snprintf(commands[i], size, "egap/eGap -m %d --em --bwt --lcp --cda --cbytes 1 --sl --slbytes 2 ", nodeMemory);
+            for(c = 0; c < node->children; c++)
+                len += snprintf(commands[i] + len, size - len, "%s/%s.bwt ", tmpDir, tree[level-1][node->firstChild+c].name);
+            snprintf(commands[i] + len, size - len, "-o %s/%s.part", tmpDir, node->name);
+            printf("%s\n", commands[i]);
+        }
+
+        metricsSystemAll(commands, statuses, count, parallel);
+
+        for(i = 0; i < count; i++){
+            mergeNode *node = running[i];
+            mergeNode *children = &tree[level-1][node->firstChild];
+            // merges of the inputs already have the genome of each suffix
+            // the root is only read by the BOSS construction, the other merges are merged again by eGap
+            if(!eGapSucceeded(statuses[i]) || (level > 1 && remapDA(node, children) != 0) || (level == levels && (capMergeArrays(node->name) != 0 || compressMergeArrays(node->name, mergeDABytes(node->count)) != 0)) || commitEGapOutputs(node->name, node->key) != 0){
+                printf("Error during eGap merge files");
+            } else if(level > 1 && !keepTmp){
+                for(c = 0; c < node->children; c++)
+                    removeEGapOutputs(children[c].name, children[c].key);
+            }
+            free(commands[i]);
+        }
     }
+
+    for(level = 0; level <= levels; level++)
+        free(tree[level]);
+    free(tree);
+    free(width);
+    free(commands);
+    free(statuses);
+    free(running);
 }
 
-void computeMergeFiles(char *path, char *file1, char *file2, int memory){
-    int len1 = strlen(file1); 
-    int len2 = strlen(file2);
+void computeMergeFiles(char *path, char *file1, char *file2, uint64_t key, int memory){
+    char mergeName[FILE_PATH];
+    snprintf(mergeName, FILE_PATH, "merge.%s-%s", file1, file2);
 
-    char output[len1+len2+15];
-    snprintf(output, len1+len2+15, "tmp/merge.%s-%s.bwt", file1, file2);
-    FILE *tmp = fopen(output, "r");
-    if(!tmp){
-        char eGapMerge[FILE_PATH];
-        snprintf(eGapMerge, FILE_PATH, "egap/eGap -m %d --em --bwt --lcp --cda --cbytes 1 --sl --slbytes 2 --rev tmp/%s.bwt tmp/%s.bwt -o tmp/merge.%s-%s", memory, file1, file2, file1, file2);
-        int systemCall = system(eGapMerge);
-        if(systemCall == -1){
+    if(!eGapOutputsValid(mergeName, key)){
+        char eGapMerge[5*FILE_PATH];
+        snprintf(eGapMerge, 5*FILE_PATH, "egap/eGap -m %d --em --bwt --lcp --cda --cbytes 1 --sl --slbytes 2 --rev %s/%s.bwt %s/%s.bwt -o %s/%s.part", memory, tmpDir, file1, tmpDir, file2, tmpDir, mergeName);
+        int systemCall = metricsSystem(eGapMerge);
+        if(!eGapSucceeded(systemCall) || capMergeArrays(mergeName) != 0 || compressMergeArrays(mergeName, 1) != 0 || commitEGapOutputs(mergeName, key) != 0){
             printf("Error during eGap merge files");
         }
     } else {
         printf("%s-%s merge files already computed!\n", file1, file2);
-        fclose(tmp);
     }
 }
 
@@ -97,8 +513,8 @@ void printDistanceMatrixes(double **Dm, double **De, char **files, int files_n,
     char *ptr;
 
     int len = strlen(path);
-    char folder[len];
-    strncpy(folder, basename(path), len);
+    char folder[len+1];
+    strncpy(folder, basename(path), len+1);
 
     char expectationDmat[FILE_PATH];
     char entropyDmat[FILE_PATH];
@@ -108,17 +524,17 @@ void printDistanceMatrixes(double **Dm, double **De, char **files, int files_n,
         if (ptr != NULL)
             *ptr = '\0';
 
-        snprintf(expectationDmat, FILE_PATH, "results/%s_expectation", folder);
-        snprintf(entropyDmat, FILE_PATH, "results/%s_entropy", folder);
+        snprintf(expectationDmat, FILE_PATH, "%s/%s_expectation", outDir, folder);
+        snprintf(entropyDmat, FILE_PATH, "%s/%s_entropy", outDir, folder);
 
-        #if COVERAGE
+        if(runMode.coverage){
             strcat(expectationDmat, "_coverage");
             strcat(entropyDmat, "_coverage");
-        #endif
-        #if ALL_VS_ALL
+        }
+        if(runMode.allVsAll){
             strcat(expectationDmat, "_all");
             strcat(entropyDmat, "_all");
-        #endif
+        }
 
         char extension[FILE_PATH];
         snprintf(extension, FILE_PATH, "_k_%d.dmat", k);
@@ -126,17 +542,17 @@ void printDistanceMatrixes(double **Dm, double **De, char **files, int files_n,
         strcat(entropyDmat, extension);
 
     } else {
-        snprintf(expectationDmat, FILE_PATH, "results/%s_expectation", path);            
-        snprintf(entropyDmat, FILE_PATH, "results/%s_entropy",  path);            
+        snprintf(expectationDmat, FILE_PATH, "%s/%s_expectation", outDir, path);
+        snprintf(entropyDmat, FILE_PATH, "%s/%s_entropy", outDir, path);
 
-        #if COVERAGE
+        if(runMode.coverage){
             strcat(expectationDmat, "_coverage");
             strcat(entropyDmat, "_coverage");
-        #endif
-        #if ALL_VS_ALL
+        }
+        if(runMode.allVsAll){
             strcat(expectationDmat, "_all");
             strcat(entropyDmat, "_all");
-        #endif
+        }
 
         char extension[FILE_PATH];
         snprintf(extension, FILE_PATH, "_k_%d.dmat", k);
@@ -191,37 +607,75 @@ void printDistanceMatrixes(double **Dm, double **De, char **files, int files_n,
     computeNewickFiles(expectationDmat);
 }
 
-FILE* getBossInfoFile(char* file1, char* file2, int k, int write){
-    char bossInfo[FILE_PATH];
+void printPairDistances(char *name, int k, char **files, int *pairs, int pairCount, double *expectation, double *entropy){
+    char pairsFileName[FILE_PATH];
+    snprintf(pairsFileName, FILE_PATH, "%s/%s%s_all_k_%d.pairs", outDir, name, runMode.coverage ? "_coverage" : "", k);
+    FILE *pairsFile = fopen(pairsFileName, "w");
+    if(pairsFile == NULL){
+        fprintf(stderr, "Unable to write file %s\n", pairsFileName);
+        exit(-1);
+    }
+    fprintf(pairsFile, "genome1\tgenome2\texpectation\tentropy\n");
+    for(int p = 0; p < pairCount; p++)
+        fprintf(pairsFile, "%s\t%s\t%lf\t%lf\n", files[pairs[2*p]], files[pairs[2*p+1]], expectation[p], entropy[p]);
+    fclose(pairsFile);
+    printf("BWSD of %d pairs can be found in %s\n", pairCount, pairsFileName);
+}
 
-    #if ALL_VS_ALL
-    snprintf(bossInfo, FILE_PATH, "results/%s_k_%d_boss.info", file1, k);
-    #else
-    snprintf(bossInfo, FILE_PATH, "results/%s-%s_k_%d_boss.info", file1, file2, k);   
-    #endif
+void printEstimatedPairs(char *name, int k, char **files, int count, char *exact, double **Dm, double **De){
+    char estimatedFileName[FILE_PATH];
+    snprintf(estimatedFileName, FILE_PATH, "%s/%s%s%s_k_%d.estimated", outDir, name, runMode.coverage ? "_coverage" : "", runMode.allVsAll ? "_all" : "", k);
+    FILE *estimatedFile = fopen(estimatedFileName, "w");
+    if(estimatedFile == NULL){
+        fprintf(stderr, "Unable to write file %s\n", estimatedFileName);
+        exit(-1);
+    }
+    int estimated = 0;
+    fprintf(estimatedFile, "genome1\tgenome2\texpectation\tentropy\n");
+    for(int i = 0; i < count; i++){
+        for(int j = i+1; j < count; j++){
+            if(!exact[i*count+j]){
+                fprintf(estimatedFile, "%s\t%s\t%lf\t%lf\n", files[i], files[j], Dm[j][i], De[j][i]);
+                estimated++;
+            }
+        }
+    }
+    fclose(estimatedFile);
+    printf("%d of %d pairs of the distance matrixes are estimated from their sketches, they can be found in %s\n", estimated, count*(count-1)/2, estimatedFileName);
+}
 
-    if(write){
-        return fopen(bossInfo, "w");
+void printNeighbors(char *name, int k, char **files, bwsdNeighbors *neighbors){
+    char knnFileName[FILE_PATH];
+    snprintf(knnFileName, FILE_PATH, "%s/%s%s%s_k_%d.knn", outDir, name, runMode.coverage ? "_coverage" : "", runMode.allVsAll ? "_all" : "", k);
+    FILE *knnFile = fopen(knnFileName, "w");
+    if(knnFile == NULL){
+        fprintf(stderr, "Unable to write file %s\n", knnFileName);
+        exit(-1);
+    }
+    bwsdNeighborsSort(neighbors);
+    fprintf(knnFile, "genome\tneighbor\texpectation\tentropy\n");
+    for(int g = 0; g < neighbors->genomes; g++){
+        bwsdNeighbor *heap = &neighbors->heaps[(size_t)g*neighbors->knn];
+        for(int n = 0; n < neighbors->count[g]; n++)
+            fprintf(knnFile, "%s\t%s\t%lf\t%lf\n", files[g], files[heap[n].genome], heap[n].expectation, heap[n].entropy);
     }
-    return fopen(bossInfo, "r");
+    fclose(knnFile);
+    printf("%d nearest genomes of each genome can be found in %s\n", neighbors->knn, knnFileName);
 }
 
 FILE* getInfoFile(char* file1, char* file2, int k, int update){
     char info[FILE_PATH];
 
-    #if ALL_VS_ALL
-    snprintf(info, FILE_PATH, "results/%s_k_%d", file1, k);
-    #else
-    snprintf(info, FILE_PATH, "results/%s-%s_k_%d", file1, file2, k);   
-    #endif
+    if(runMode.allVsAll)
+        snprintf(info, FILE_PATH, "%s/%s_k_%d", outDir, file1, k);
+    else
+        snprintf(info, FILE_PATH, "%s/%s-%s_k_%d", outDir, file1, file2, k);
 
-    #if COVERAGE
-    strcat(info, "_cov");
-    #endif
+    if(runMode.coverage)
+        strcat(info, "_cov");
 
-    #if ALL_VS_ALL
-    strcat(info, "_all");
-    #endif
+    if(runMode.allVsAll)
+        strcat(info, "_all");
 
     strcat(info, ".info");
 
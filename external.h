@@ -1,11 +1,87 @@
-void computeFile(char *path, char *file, int memory);
+#ifndef EXTERNAL_H
+#define EXTERNAL_H
 
-void computeMergeFileAll(char *path, char **files, int numberOfFiles, int memory);
+#include <stdint.h>
+#include "sketch.h"
+#include "bwsd.h"
 
-void computeMergeFiles(char *path, char *file1, char *file2, int memory);
+/* Modes of a run, the ALL_VS_ALL, COVERAGE and DEBUG make options are
+   their defaults
+     allVsAll: one BOSS for every genome (bwsdAll) instead of one per pair
+     coverage: BWSD also considers the coverage of each (k+1)-mer
+     debug: BOSS and BWSD details in the .info files
+ */
+typedef struct {
+    int allVsAll;
+    int coverage;
+    int debug;
+} gcbbMode;
+
+extern gcbbMode runMode;
+
+// Directory of the eGap arrays and the manifest, and directory of the results
+extern char *tmpDir;
+extern char *outDir;
+
+// Creates path and its missing parents, returns 0 on success
+int makeDirectory(char *path);
+
+// Manifest keys of the eGap arrays of an input, of all inputs and of a pair, known before they are computed
+uint64_t fileKey(char *path, char *file);
+
+uint64_t mergeFileAllKey(uint64_t *fileKeys, int numberOfFiles);
+
+uint64_t mergeFilesKey(uint64_t key1, uint64_t key2);
+
+/* eGap arrays of an input (<tmpDir>/<file>.*), of all inputs
+   (<tmpDir>/merge.<path>.*) and of a pair (<tmpDir>/merge.<file1>-<file2>.*).
+   Arrays already in the manifest with the same key are reused.
+
+   All inputs are merged by a tree of eGap merges of up to MERGE_FANIN
+   inputs (or merges) each, the merges of a level running in parallel with
+   up to threads processes that share memory. The DA of a merge of merges is
+   remapped to genome ids, so the DA of every merge has the genome of each
+   suffix, in 1 byte (.1.cda) up to 256 genomes and 2 bytes (.2.cda) above.
+   Merges between the inputs and the root are removed unless keepTmp.
+
+   The LCP and SL of the root and of a pair, only compared with k-1, k and
+   k+1 by the BOSS construction, are capped to MERGE_LCP_MAX in 1 byte
+   (.1.lcp and .1.sl), so k must be smaller than MERGE_LCP_MAX
+ */
+#define MERGE_LCP_MAX 255
+
+/* zlib level (0 to keep it raw, the default) of each array of the root and
+   of a pair, compressed to chunk files (chunkfile.h) once they are capped.
+   main may change them with --tmp-compression */
+enum { MERGE_BWT, MERGE_DA, MERGE_LCP, MERGE_SL, MERGE_ARRAYS };
+
+extern int mergeCompression[MERGE_ARRAYS];
+
+extern const char *mergeArrayNames[MERGE_ARRAYS];
+
+void computeFile(char *path, char *file, uint64_t key, int memory);
+
+// MinHash sketch of the kmer-mers of an input (<tmpDir>/<file>.<kmer>.sketch), reused while the input does not change
+sketch* computeSketch(char *path, char *file, int kmer);
+
+void computeMergeFileAll(char *path, char **files, uint64_t *fileKeys, uint64_t key, int numberOfFiles, int memory, int threads, int keepTmp);
+
+void computeMergeFiles(char *path, char *file1, char *file2, uint64_t key, int memory);
+
+// Removes the eGap arrays <tmpDir>/<name>.* committed with key
+void removeEGapOutputs(char *name, uint64_t key);
 
 void printDistanceMatrixes(double **Dm, double **De, char **files, int files_n, char *path, int k);
 
+// Writes the BWSD of the pairs (files[pairs[2*p]], files[pairs[2*p+1]]) of the all-vs-all BOSS of name to <outDir>/<name>_all_k_<k>.pairs
+void printPairDistances(char *name, int k, char **files, int *pairs, int pairCount, double *expectation, double *entropy);
+
+// Writes the pairs not in exact (exact[i*count+j], i < j), whose BWSD is estimated from their sketches, to <outDir>/<name>[_coverage][_all]_k_<k>.estimated
+void printEstimatedPairs(char *name, int k, char **files, int count, char *exact, double **Dm, double **De);
+
+// Writes the nearest genomes of each genome, the nearest first, to <outDir>/<name>[_coverage][_all]_k_<k>.knn
+void printNeighbors(char *name, int k, char **files, bwsdNeighbors *neighbors);
+
 // If ALL_VS_ALL, pass path as file1 and NULL as file2
 /* update
     0: creates file "w";
@@ -13,4 +89,4 @@ void printDistanceMatrixes(double **Dm, double **De, char **files, int files_n,
 */
 FILE* getInfoFile(char* file1, char* file2, int k, int update);
 
-FILE* getBossInfoFile(char* file1, char* file2, int k, int write);
\ No newline at end of file
+#endif
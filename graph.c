@@ -0,0 +1,343 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "graph.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+static const char symbols[BOSS_SYMBOLS] = {'$', 'A', 'C', 'G', 'N', 'T'};
+
+typedef struct {
+    char symbol;
+    short color;
+    int coverage;
+} coloredEdge;
+
+static int compareColoredEdges(const void *element1, const void *element2){
+    coloredEdge *e1 = (coloredEdge*)element1;
+    coloredEdge *e2 = (coloredEdge*)element2;
+    if(e1->symbol == e2->symbol)
+        return e1->color - e2->color;
+    return e1->symbol - e2->symbol;
+}
+
+int bossGraphSymbolIndex(char symbol){
+    switch(symbol){
+        case '$': return 0;
+        case 'A': return 1;
+        case 'C': return 2;
+        case 'G': return 3;
+        case 'N': return 4;
+        case 'T': return 5;
+        default: return -1;
+    }
+}
+
+// Entries of $-padded vertices with the same label are not contiguous in last, so vertices are detected by their labels
+static int sameVertex(short *summarizedLCP, short *summarizedSL, int k, size_t e){
+    int length = MIN(summarizedSL[e]-1, k);
+    int previousLength = MIN(summarizedSL[e-1]-1, k);
+    return summarizedLCP[e] >= k || (length == previousLength && summarizedLCP[e] >= length);
+}
+
+bossGraph* bossGraphCreate(bossFile *boss){
+    size_t i, j;
+    int k = boss->header->k;
+    size_t n = boss->header->n;
+
+    if(boss->header->minAbundance > 1){
+        fprintf(stderr, "BOSS built with the solid k-mer filter (-s %d) can not be navigated\n", boss->header->minAbundance);
+        return NULL;
+    }
+
+    char *W = (char*)bossFileSection(boss, BOSS_W);
+    short *colors = (short*)bossFileSection(boss, BOSS_COLORS);
+    const unsigned char *coverage = (unsigned char*)bossFileSection(boss, BOSS_COVERAGE);
+    short *summarizedLCP = (short*)bossFileSection(boss, BOSS_SUMMARIZED_LCP);
+    short *summarizedSL = (short*)bossFileSection(boss, BOSS_SUMMARIZED_SL);
+
+    bossGraph *g = calloc(1, sizeof(bossGraph));
+    g->k = k;
+    g->samples = boss->header->samples;
+    g->colors = malloc((n+1)*sizeof(short));
+    g->coverage = malloc((n+1)*sizeof(int));
+
+    // edges and vertices are at most the BOSS length
+    uint8_t *codes = malloc(n+1);
+    char *last = calloc(n+1, sizeof(char));
+    char *colorStart = calloc(n+1, sizeof(char));
+
+    int vertexCapacity = 64;
+    coloredEdge *vertex = malloc(vertexCapacity*sizeof(coloredEdge));
+
+    size_t unflagged[BOSS_SYMBOLS] = {0};
+    int seen[BOSS_SYMBOLS] = {0};
+    size_t sources = 0;
+
+    size_t start = 0;
+    while(start < n){
+        size_t end = start+1;
+        while(end < n && sameVertex(summarizedLCP, summarizedSL, k, end)) end++;
+
+        if(end-start > (size_t)vertexCapacity){
+            vertexCapacity = end-start;
+            vertex = realloc(vertex, vertexCapacity*sizeof(coloredEdge));
+        }
+        int size = 0;
+        for(i = start; i < end; i++){
+            if(bossGraphSymbolIndex(W[i]) < 0){
+                fprintf(stderr, "BOSS with symbol %c out of the $ACGNT alphabet can not be navigated\n", W[i]);
+                free(codes); free(last); free(colorStart); free(vertex);
+                free(g->colors); free(g->coverage); free(g);
+                return NULL;
+            }
+            vertex[size].symbol = bossGraphSymbolIndex(W[i]);
+            vertex[size].color = colors[i];
+            vertex[size].coverage = bossCoverageNext(&coverage);
+            size++;
+        }
+        qsort(vertex, size, sizeof(coloredEdge), compareColoredEdges);
+
+        if(summarizedSL[start] == 1)
+            sources++;
+
+        // a new (k-1)-mer suffix starts, targets of its edges were not reached yet
+        if(start == 0 || summarizedLCP[start] < k-1)
+            memset(seen, 0, sizeof(seen));
+
+        for(j = 0; j < (size_t)size; j++){
+            int symbol = vertex[j].symbol;
+            if(j > 0 && vertex[j-1].symbol == symbol){
+                if(vertex[j-1].color == vertex[j].color){
+                    // same edge from another read of the same genome
+                    g->coverage[g->coloredEdges-1] += vertex[j].coverage;
+                    continue;
+                }
+            } else {
+                int flagged = symbol != 0 && seen[symbol];
+                if(symbol != 0 && !flagged) unflagged[symbol]++;
+                seen[symbol] = 1;
+                codes[g->edges] = 2*symbol + flagged;
+                colorStart[g->coloredEdges] = 1;
+                g->edges++;
+            }
+            g->colors[g->coloredEdges] = vertex[j].color;
+            g->coverage[g->coloredEdges] = vertex[j].coverage;
+            g->coloredEdges++;
+        }
+        last[g->edges-1] = 1;
+        g->nodes++;
+
+        start = end;
+    }
+    free(vertex);
+
+    g->F[0] = 0;
+    g->F[1] = sources;
+    for(i = 1; i < BOSS_SYMBOLS; i++)
+        g->F[i+1] = g->F[i] + unflagged[i];
+
+    if(sources > 1 || g->F[BOSS_SYMBOLS] != g->nodes){
+        fprintf(stderr, "BOSS with %ld vertices can not be navigated (%ld vertices reached)\n", g->nodes, g->F[BOSS_SYMBOLS]);
+        free(codes); free(last); free(colorStart);
+        free(g->colors); free(g->coverage); free(g);
+        return NULL;
+    }
+
+    g->last = rankbv_create(g->edges, 2);
+    for(i = 0; i < g->edges; i++)
+        if(last[i]) rankbv_setbit(g->last, i);
+    rankbv_build(g->last);
+
+    g->colorStart = rankbv_create(g->coloredEdges, 2);
+    for(i = 0; i < g->coloredEdges; i++)
+        if(colorStart[i]) rankbv_setbit(g->colorStart, i);
+    rankbv_build(g->colorStart);
+
+    g->W = wavelet_create(codes, g->edges, 2*BOSS_SYMBOLS);
+
+    free(codes); free(last); free(colorStart);
+
+    return g;
+}
+
+void bossGraphFree(bossGraph *g){
+    rankbv_free(g->last);
+    rankbv_free(g->colorStart);
+    wavelet_free(g->W);
+    free(g->colors);
+    free(g->coverage);
+    free(g);
+}
+
+char bossGraphSymbol(bossGraph *g, size_t e){
+    return symbols[wavelet_access(g->W, e)/2];
+}
+
+size_t bossGraphEdgeNode(bossGraph *g, size_t e){
+    return e == 0 ? 0 : rankbv_rank1(g->last, e-1);
+}
+
+size_t bossGraphNodeStart(bossGraph *g, size_t v){
+    return v == 0 ? 0 : rankbv_select1(g->last, v)+1;
+}
+
+size_t bossGraphNodeEnd(bossGraph *g, size_t v){
+    return rankbv_select1(g->last, v+1);
+}
+
+static int lastSymbolIndex(bossGraph *g, size_t v){
+    int s = 0;
+    while(s < BOSS_SYMBOLS-1 && g->F[s+1] <= v) s++;
+    return s;
+}
+
+char bossGraphLastSymbol(bossGraph *g, size_t v){
+    return symbols[lastSymbolIndex(g, v)];
+}
+
+void bossGraphLabel(bossGraph *g, size_t v, char *label){
+    int i;
+    for(i = g->k-1; i >= 0; i--){
+        int s = lastSymbolIndex(g, v);
+        label[i] = symbols[s];
+        if(s == 0){
+            // the rest of the label is padding
+            while(--i >= 0) label[i] = '$';
+            break;
+        }
+        v = bossGraphEdgeNode(g, bossGraphBackward(g, v));
+    }
+}
+
+int bossGraphOutdegree(bossGraph *g, size_t v){
+    size_t start = bossGraphNodeStart(g, v);
+    size_t end = bossGraphNodeEnd(g, v);
+    // $ is the smallest symbol, so it can only be the first edge
+    return end-start+1 - (wavelet_access(g->W, start)/2 == 0);
+}
+
+size_t bossGraphOutgoingEdge(bossGraph *g, size_t v, char symbol){
+    size_t e;
+    int s = bossGraphSymbolIndex(symbol);
+    if(s <= 0) return BOSS_GRAPH_NONE;
+
+    size_t end = bossGraphNodeEnd(g, v);
+    for(e = bossGraphNodeStart(g, v); e <= end; e++){
+        if(wavelet_access(g->W, e)/2 == s)
+            return e;
+    }
+    return BOSS_GRAPH_NONE;
+}
+
+size_t bossGraphOutgoing(bossGraph *g, size_t v, char symbol){
+    size_t e = bossGraphOutgoingEdge(g, v, symbol);
+    return e == BOSS_GRAPH_NONE ? BOSS_GRAPH_NONE : bossGraphForward(g, e);
+}
+
+size_t bossGraphForward(bossGraph *g, size_t e){
+    int s = wavelet_access(g->W, e)/2;
+    if(s == 0) return BOSS_GRAPH_NONE;
+    // flagged edges share the target of the previous unflagged edge with the same symbol
+    return g->F[s] + wavelet_rank(g->W, 2*s, e) - 1;
+}
+
+size_t bossGraphBackward(bossGraph *g, size_t v){
+    int s = lastSymbolIndex(g, v);
+    if(s == 0) return BOSS_GRAPH_NONE;
+    return wavelet_select(g->W, 2*s, v - g->F[s] + 1);
+}
+
+// Edges [first, end) with symbol s between the unflagged edge into v and the next one hold every edge into v
+static size_t incomingEnd(bossGraph *g, size_t v, int s){
+    size_t next = wavelet_select(g->W, 2*s, v - g->F[s] + 2);
+    return next == BOSS_GRAPH_NONE ? g->edges : next;
+}
+
+int bossGraphIndegree(bossGraph *g, size_t v){
+    int s = lastSymbolIndex(g, v);
+    if(s == 0) return 0;
+    size_t first = bossGraphBackward(g, v);
+    size_t end = incomingEnd(g, v, s);
+    return 1 + wavelet_rank(g->W, 2*s+1, end-1) - wavelet_rank(g->W, 2*s+1, first);
+}
+
+size_t bossGraphNextIncoming(bossGraph *g, size_t v, size_t e){
+    int s = wavelet_access(g->W, e)/2;
+    size_t next = wavelet_select(g->W, 2*s+1, wavelet_rank(g->W, 2*s+1, e)+1);
+    return next < incomingEnd(g, v, s) ? next : BOSS_GRAPH_NONE;
+}
+
+size_t bossGraphIncoming(bossGraph *g, size_t v, char symbol){
+    int i;
+    int s = lastSymbolIndex(g, v);
+    if(s == 0) return BOSS_GRAPH_NONE;
+
+    size_t first = bossGraphBackward(g, v);
+    size_t end = incomingEnd(g, v, s);
+    size_t flagged = wavelet_rank(g->W, 2*s+1, first);
+    size_t e = first;
+
+    while(e != BOSS_GRAPH_NONE && e < end){
+        size_t u = bossGraphEdgeNode(g, e);
+        // first symbol of the label of u
+        size_t x = u;
+        for(i = 0; i < g->k-1 && lastSymbolIndex(g, x) != 0; i++)
+            x = bossGraphEdgeNode(g, bossGraphBackward(g, x));
+        if(bossGraphLastSymbol(g, x) == symbol)
+            return u;
+        e = wavelet_select(g->W, 2*s+1, ++flagged);
+    }
+    return BOSS_GRAPH_NONE;
+}
+
+int bossGraphExtend(bossGraph *g, size_t *first, size_t *last, char symbol){
+    int s = bossGraphSymbolIndex(symbol);
+    if(s <= 0) return 0;
+
+    size_t start = bossGraphNodeStart(g, *first);
+    size_t end = bossGraphNodeEnd(g, *last);
+    size_t unflaggedBefore = wavelet_rank(g->W, 2*s, start-1);
+    size_t unflaggedUntil = wavelet_rank(g->W, 2*s, end);
+    size_t flaggedBefore = wavelet_rank(g->W, 2*s+1, start-1);
+    size_t flaggedUntil = wavelet_rank(g->W, 2*s+1, end);
+
+    if(unflaggedUntil == unflaggedBefore && flaggedUntil == flaggedBefore)
+        return 0;
+
+    // a flagged edge before the first unflagged one reaches the target of the previous unflagged edge
+    int flaggedFirst = unflaggedUntil == unflaggedBefore;
+    if(!flaggedFirst && flaggedUntil > flaggedBefore){
+        size_t firstUnflagged = wavelet_select(g->W, 2*s, unflaggedBefore+1);
+        flaggedFirst = wavelet_rank(g->W, 2*s+1, firstUnflagged) > flaggedBefore;
+    }
+
+    *first = g->F[s] + unflaggedBefore - flaggedFirst;
+    *last = g->F[s] + unflaggedUntil - 1;
+    return 1;
+}
+
+size_t bossGraphEdgeColors(bossGraph *g, size_t e, size_t *first){
+    *first = rankbv_select1(g->colorStart, e+1);
+    size_t end = e+1 < g->edges ? rankbv_select1(g->colorStart, e+2) : g->coloredEdges;
+    return end - *first;
+}
+
+int bossGraphHasColor(bossGraph *g, size_t e, short color){
+    size_t i, first;
+    size_t count = bossGraphEdgeColors(g, e, &first);
+    for(i = first; i < first+count; i++){
+        if(g->colors[i] == color)
+            return 1;
+    }
+    return 0;
+}
+
+void bossGraphNodeColors(bossGraph *g, size_t v, uint64_t *genomes){
+    size_t i, first;
+    size_t end = bossGraphNodeEnd(g, v);
+    bossGraphEdgeColors(g, bossGraphNodeStart(g, v), &first);
+    size_t colorsEnd = end+1 < g->edges ? rankbv_select1(g->colorStart, end+2) : g->coloredEdges;
+    for(i = first; i < colorsEnd; i++)
+        genomes[g->colors[i]/64] |= 1ULL << (g->colors[i]%64);
+}
@@ -0,0 +1,99 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "bossfile.h"
+#include "lib/rankbv.h"
+#include "lib/wavelet.h"
+
+// Returned by navigation functions when there is no such node or edge
+#define BOSS_GRAPH_NONE ((size_t)-1)
+
+// $, A, C, G, N, T
+#define BOSS_SYMBOLS 6
+
+/* Navigational colored BOSS built from a BOSS file.
+
+   Edges of the same vertex and symbol coming from distinct genomes are
+   collapsed into one edge, with its genomes kept in colors. Vertices
+   with the same $-padded label are collapsed as well.
+
+   Vertex v is the range of edges ending at the (v+1)-th 1 in last. W
+   stores 2*symbol+flagged for each edge, where flagged edges are the
+   ones whose target is also reached by a previous edge with the same
+   symbol (W- in the BOSS paper).
+ */
+typedef struct {
+    int k;
+    int samples;
+    size_t edges;
+    size_t nodes;
+    size_t F[BOSS_SYMBOLS+1]; // first vertex whose label ends with each symbol
+    rankbv_t *last;
+    wavelet_t *W;
+    // colors[colorStart select] of every edge, sorted
+    rankbv_t *colorStart;
+    size_t coloredEdges;
+    short *colors;
+    int *coverage;
+} bossGraph;
+
+// Returns NULL if the BOSS can not be navigated (e.g. built with the solid k-mer filter)
+bossGraph* bossGraphCreate(bossFile *boss);
+
+void bossGraphFree(bossGraph *g);
+
+int bossGraphSymbolIndex(char symbol);
+
+// Symbol of edge e
+char bossGraphSymbol(bossGraph *g, size_t e);
+
+// Vertex whose outgoing edges include e
+size_t bossGraphEdgeNode(bossGraph *g, size_t e);
+
+// First and last outgoing edges of v
+size_t bossGraphNodeStart(bossGraph *g, size_t v);
+size_t bossGraphNodeEnd(bossGraph *g, size_t v);
+
+// Last symbol of the label of v, $ for the source vertex
+char bossGraphLastSymbol(bossGraph *g, size_t v);
+
+// Writes the k symbols of the label of v, $-padded, in label
+void bossGraphLabel(bossGraph *g, size_t v, char *label);
+
+// Number of outgoing edges of v, not counting $
+int bossGraphOutdegree(bossGraph *g, size_t v);
+
+// Edge of v labeled with symbol
+size_t bossGraphOutgoingEdge(bossGraph *g, size_t v, char symbol);
+
+// Target of the outgoing edge of v labeled with symbol
+size_t bossGraphOutgoing(bossGraph *g, size_t v, char symbol);
+
+// Target of edge e
+size_t bossGraphForward(bossGraph *g, size_t e);
+
+// First edge, in BOSS order, whose target is v
+size_t bossGraphBackward(bossGraph *g, size_t v);
+
+int bossGraphIndegree(bossGraph *g, size_t v);
+
+// Edge after e whose target is v, starting from bossGraphBackward(g, v)
+size_t bossGraphNextIncoming(bossGraph *g, size_t v, size_t e);
+
+// Predecessor of v whose label starts with symbol
+size_t bossGraphIncoming(bossGraph *g, size_t v, char symbol);
+
+/* Narrows the vertices [*first, *last], whose labels end with the same
+   string, to the targets of their edges labeled with symbol. Returns 0
+   if there is no such edge */
+int bossGraphExtend(bossGraph *g, size_t *first, size_t *last, char symbol);
+
+// Number of genomes of edge e, their colors and coverage start at position *first
+size_t bossGraphEdgeColors(bossGraph *g, size_t e, size_t *first);
+
+int bossGraphHasColor(bossGraph *g, size_t e, short color);
+
+// Sets the bits of the genomes of the edges leaving v
+void bossGraphNodeColors(bossGraph *g, size_t v, uint64_t *genomes);
+
+#endif
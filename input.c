@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "input.h"
+
+#define FILE_PATH 1024
+#define LINE_BUFFER 65536
+
+typedef struct {
+    char *extension;
+    char *decompressor;
+} compression;
+
+static const compression compressions[] = {
+    {".gz", "gzip -dc"},
+    {".bz2", "bzip2 -dc"},
+    {".xz", "xz -dc"},
+    {".zst", "zstd -dc"},
+};
+
+static const char *sequenceExtensions[] = {".fastq", ".fq", ".fasta", ".fa", ".fna"};
+
+#define COMPRESSIONS (sizeof(compressions)/sizeof(compressions[0]))
+#define SEQUENCE_EXTENSIONS (sizeof(sequenceExtensions)/sizeof(sequenceExtensions[0]))
+
+static int endsWith(char *str, int len, const char *suffix){
+    int suffixLen = strlen(suffix);
+    return len >= suffixLen && strncmp(str+len-suffixLen, suffix, suffixLen) == 0;
+}
+
+static const compression* getCompression(char *fileName){
+    int len = strlen(fileName);
+    for(size_t i = 0; i < COMPRESSIONS; i++){
+        if(endsWith(fileName, len, compressions[i].extension))
+            return &compressions[i];
+    }
+    return NULL;
+}
+
+int isSequenceFile(char *fileName){
+    int len = strlen(fileName);
+    const compression *c = getCompression(fileName);
+    if(c != NULL)
+        len -= strlen(c->extension);
+
+    for(size_t i = 0; i < SEQUENCE_EXTENSIONS; i++){
+        if(endsWith(fileName, len, sequenceExtensions[i]))
+            return 1;
+    }
+    return 0;
+}
+
+int isCompressedFile(char *fileName){
+    return getCompression(fileName) != NULL;
+}
+
+FILE* openSequenceFile(char *fileName, int *isPipe){
+    const compression *c = getCompression(fileName);
+    if(c == NULL){
+        *isPipe = 0;
+        return fopen(fileName, "r");
+    }
+
+    // quote the file name for the shell, escaping single quotes
+    char command[2*FILE_PATH];
+    int pos = snprintf(command, FILE_PATH, "%s '", c->decompressor);
+    for(char *ch = fileName; *ch && pos < 2*FILE_PATH-8; ch++){
+        if(*ch == '\''){
+            strcpy(command+pos, "'\\''");
+            pos += 4;
+        } else {
+            command[pos++] = *ch;
+        }
+    }
+    strcpy(command+pos, "'");
+
+    *isPipe = 1;
+    return popen(command, "r");
+}
+
+int closeSequenceFile(FILE *sequenceFile, int isPipe){
+    if(isPipe)
+        return pclose(sequenceFile);
+    return fclose(sequenceFile);
+}
+
+// Maps lower case and IUPAC ambiguity codes to the BOSS alphabet {A,C,G,N,T}
+char normalizeBase(char base){
+    switch(toupper((unsigned char)base)){
+        case 'A': return 'A';
+        case 'C': return 'C';
+        case 'G': return 'G';
+        case 'T': return 'T';
+        case 'U': return 'T';
+        default: return 'N';
+    }
+}
+
+static size_t sequenceLength(char *line){
+    size_t len = 0;
+    for(char *ch = line; *ch; ch++){
+        if(!isspace((unsigned char)*ch))
+            len++;
+    }
+    return len;
+}
+
+size_t readSequenceFile(char *inputFile, void (*onRead)(void *arg), void (*onBases)(char *line, void *arg), void *arg){
+    int isPipe;
+    FILE *input = openSequenceFile(inputFile, &isPipe);
+    if(input == NULL){
+        fprintf(stderr, "Unable to read file %s\n", inputFile);
+        exit(-1);
+    }
+
+    char *line = (char*)malloc(LINE_BUFFER*sizeof(char));
+    size_t reads = 0;
+    // 0: header, 1: sequence, 2: FASTQ quality
+    int state = 0;
+    int isFastq = 0;
+    size_t seqLen = 0, qualLen = 0;
+    int lineStart = 1;
+
+    while(fgets(line, LINE_BUFFER, input) != NULL){
+        int isLineStart = lineStart;
+        lineStart = line[strlen(line)-1] == '\n';
+
+        if(isLineStart && state != 2 && (line[0] == '>' || line[0] == '@')){
+            onRead(arg);
+            isFastq = line[0] == '@';
+            state = 1;
+            seqLen = 0;
+            reads++;
+            // skip the rest of long headers
+            while(!lineStart && fgets(line, LINE_BUFFER, input) != NULL)
+                lineStart = line[strlen(line)-1] == '\n';
+            continue;
+        }
+
+        if(state == 1){
+            if(isFastq && isLineStart && line[0] == '+'){
+                state = 2;
+                qualLen = 0;
+                while(!lineStart && fgets(line, LINE_BUFFER, input) != NULL)
+                    lineStart = line[strlen(line)-1] == '\n';
+                continue;
+            }
+            seqLen += sequenceLength(line);
+            onBases(line, arg);
+        } else if(state == 2){
+            qualLen += sequenceLength(line);
+            if(lineStart && qualLen >= seqLen)
+                state = 0;
+        }
+    }
+
+    free(line);
+    if(closeSequenceFile(input, isPipe) != 0){
+        fprintf(stderr, "Error while decompressing file %s\n", inputFile);
+        exit(-1);
+    }
+
+    return reads;
+}
+
+// Output of normalizeSequenceFile and whether a read was written to it
+typedef struct {
+    FILE *output;
+    size_t reads;
+} normalizedFile;
+
+static void writeNormalizedRead(void *arg){
+    normalizedFile *n = (normalizedFile*)arg;
+    if(n->reads > 0) fputc('\n', n->output);
+    fputs(">\n", n->output);
+    n->reads++;
+}
+
+static void writeNormalizedLine(char *line, void *arg){
+    normalizedFile *n = (normalizedFile*)arg;
+    for(char *ch = line; *ch; ch++){
+        if(!isspace((unsigned char)*ch))
+            fputc(normalizeBase(*ch), n->output);
+    }
+}
+
+size_t normalizeSequenceFile(char *inputFile, char *outputFile){
+    normalizedFile n = { fopen(outputFile, "w"), 0 };
+    if(n.output == NULL){
+        fprintf(stderr, "Unable to write file %s\n", outputFile);
+        exit(-1);
+    }
+
+    size_t reads = readSequenceFile(inputFile, writeNormalizedRead, writeNormalizedLine, &n);
+    if(n.reads > 0) fputc('\n', n.output);
+    fclose(n.output);
+
+    return reads;
+}
@@ -0,0 +1,22 @@
+#include <stdio.h>
+
+// Returns 1 if fileName is a FASTQ/FASTA file, optionally compressed (.gz, .bz2, .xz, .zst)
+int isSequenceFile(char *fileName);
+
+// Returns 1 if fileName is compressed with one of the supported compressors
+int isCompressedFile(char *fileName);
+
+// Opens a sequence file for streaming, decompressing it on a background pipe if needed
+FILE* openSequenceFile(char *fileName, int *isPipe);
+
+int closeSequenceFile(FILE *sequenceFile, int isPipe);
+
+char normalizeBase(char base);
+
+/* Streams the reads of inputFile, FASTQ or FASTA: onRead is called at the
+   start of each read and onBases with each line of its sequence (with the
+   line break, if any), returns the number of reads */
+size_t readSequenceFile(char *inputFile, void (*onRead)(void *arg), void (*onBases)(char *line, void *arg), void *arg);
+
+// Streams inputFile as a one-read-per-line FASTA over the {A,C,G,N,T} alphabet, returns the number of reads
+size_t normalizeSequenceFile(char *inputFile, char *outputFile);
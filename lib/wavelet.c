@@ -0,0 +1,120 @@
+#include "wavelet.h"
+
+#include "string.h"
+
+
+static inline size_t
+wavelet_onesbefore(rankbv_t* rbv,size_t p)
+{
+    return p ? rankbv_rank1(rbv,p-1) : 0;
+}
+
+wavelet_t*
+wavelet_create(const uint8_t* A,size_t n,uint32_t sigma)
+{
+    size_t i,l;
+    wavelet_t* wt = (wavelet_t*) rankbv_safecalloc(sizeof(wavelet_t));
+    wt->n = n;
+    wt->sigma = sigma;
+    wt->levels = 1;
+    while ((1U<<wt->levels) < sigma) wt->levels++;
+
+    uint8_t* cur = (uint8_t*) rankbv_safecalloc(n+1);
+    uint8_t* next = (uint8_t*) rankbv_safecalloc(n+1);
+    memcpy(cur,A,n);
+
+    /* each level is stably partitioned by its bit, zeros first */
+    for (l=0; l<wt->levels; l++) {
+        uint32_t bit = wt->levels-1-l;
+        wt->B[l] = rankbv_create(n,4);
+        size_t zeros = 0;
+        for (i=0; i<n; i++) {
+            if ((cur[i]>>bit)&1) rankbv_setbit(wt->B[l],i);
+            else zeros++;
+        }
+        rankbv_build(wt->B[l]);
+        wt->zeros[l] = zeros;
+
+        size_t z = 0, o = zeros;
+        for (i=0; i<n; i++) {
+            if ((cur[i]>>bit)&1) next[o++] = cur[i];
+            else next[z++] = cur[i];
+        }
+        uint8_t* tmp = cur; cur = next; next = tmp;
+    }
+
+    free(cur);
+    free(next);
+    return wt;
+}
+
+void
+wavelet_free(wavelet_t* wt)
+{
+    size_t l;
+    if (wt) {
+        for (l=0; l<wt->levels; l++) rankbv_free(wt->B[l]);
+        free(wt);
+    }
+}
+
+uint8_t
+wavelet_access(wavelet_t* wt,size_t i)
+{
+    size_t l;
+    uint8_t c = 0;
+    for (l=0; l<wt->levels; l++) {
+        int bit = rankbv_access(wt->B[l],i);
+        c = (c<<1)|bit;
+        if (bit) i = wt->zeros[l] + wavelet_onesbefore(wt->B[l],i);
+        else i = i - wavelet_onesbefore(wt->B[l],i);
+    }
+    return c;
+}
+
+/* occurrences of c in [0,i], wavelet_rank(wt,c,-1) = 0 */
+size_t
+wavelet_rank(wavelet_t* wt,uint8_t c,size_t i)
+{
+    size_t l;
+    if (wt->n == 0 || i == (size_t)(-1)) return 0;
+    if (i >= wt->n) i = wt->n-1;
+
+    size_t p = i+1, s = 0;
+    for (l=0; l<wt->levels; l++) {
+        size_t onesp = wavelet_onesbefore(wt->B[l],p);
+        size_t oness = wavelet_onesbefore(wt->B[l],s);
+        if ((c>>(wt->levels-1-l))&1) {
+            p = wt->zeros[l] + onesp;
+            s = wt->zeros[l] + oness;
+        } else {
+            p = p - onesp;
+            s = s - oness;
+        }
+    }
+    return p-s;
+}
+
+/* position of the x-th (1-based) occurrence of c, (size_t)-1 if there is none */
+size_t
+wavelet_select(wavelet_t* wt,uint8_t c,size_t x)
+{
+    if (x == 0 || wt->n == 0) return (size_t)(-1);
+    if (x > wavelet_rank(wt,c,wt->n-1)) return (size_t)(-1);
+
+    size_t l=0, r=wt->n-1;
+    while (l<r) {
+        size_t mid = (l+r)/2;
+        if (wavelet_rank(wt,c,mid) < x) l = mid+1;
+        else r = mid;
+    }
+    return l;
+}
+
+size_t
+wavelet_spaceusage(wavelet_t* wt)
+{
+    size_t l, bytes = sizeof(wavelet_t);
+    for (l=0; l<wt->levels; l++) bytes += rankbv_spaceusage(wt->B[l]);
+    return bytes;
+}
@@ -0,0 +1,30 @@
+#ifndef WAVELET_H
+#define WAVELET_H
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rankbv.h"
+
+/* levelwise wavelet tree (wavelet matrix layout) over small integer alphabets */
+
+typedef struct wavelet {
+    uint64_t n;
+    uint32_t sigma;
+    uint32_t levels;
+    uint64_t zeros[8];
+    rankbv_t* B[8];
+} wavelet_t;
+
+/* wavelet functions */
+wavelet_t* wavelet_create(const uint8_t* A,size_t n,uint32_t sigma);
+void       wavelet_free(wavelet_t* wt);
+uint8_t    wavelet_access(wavelet_t* wt,size_t i);
+size_t     wavelet_rank(wavelet_t* wt,uint8_t c,size_t i);
+size_t     wavelet_select(wavelet_t* wt,uint8_t c,size_t x);
+
+/* misc */
+size_t     wavelet_spaceusage(wavelet_t* wt);
+
+#endif
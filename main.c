@@ -1,30 +1,40 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <ctype.h>
 #include <dirent.h>
 #include <unistd.h>
 #include <time.h>
 #include <libgen.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 
 #include "bwsd.h"
 #include "boss.h"
 #include "external.h"
+#include "input.h"
+#include "query.h"
+#include "unitig.h"
+#include "metrics.h"
+#include "manifest.h"
+#include "chunkfile.h"
 #include "lib/rankbv.h"
 
 #define FILE_PATH 1024
+#define MAX_K_VALUES 64
 
-#ifndef COVERAGE
-	#define COVERAGE 0
-#endif
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
 
-#ifndef ALL_VS_ALL
-	#define ALL_VS_ALL 0
-#endif
-
-#ifndef DEBUG
-	#define DEBUG 0
-#endif
+// Bytes per symbol of the eGap arrays of an input (BWT, 2 bytes LCP and SL) and of a merge (also the 1 byte DA)
+#define FILE_ARRAYS_BYTES 5
+#define MERGE_ARRAYS_BYTES 6
+// Bytes per edge of the BOSS sections (last, W, Wm, colors, coverage of 1 byte up to 127, summarized LCP and SL, at most a color run and the flags), at most one edge per symbol
+#define BOSS_EDGE_BYTES 17
+// Expected compression ratio of gzip, bzip2, xz and zstd inputs
+#define COMPRESSION_RATIO 4
 
 int compareFiles(const void *element1, const void *element2) {
     const char **file1 = (const char **)element1;
@@ -32,6 +42,41 @@ int compareFiles(const void *element1, const void *element2) {
     return strcmp(*file1, *file2);
 }
 
+// Parses a comma separated list of k values (e.g. 16,21,25,31), returns how many were read
+int parseKValues(char *arg, int *kValues){
+    int kCount = 0;
+    char *token = strtok(arg, ",");
+    while(token != NULL && kCount < MAX_K_VALUES){
+        kValues[kCount++] = atoi(token);
+        // the merged LCP and SL are capped to MERGE_LCP_MAX
+        if(kValues[kCount-1] < 1 || kValues[kCount-1] >= MERGE_LCP_MAX){
+            printf("Invalid k value %s, k must be between 1 and %d\n", token, MERGE_LCP_MAX-1);
+            exit(-1);
+        }
+        token = strtok(NULL, ",");
+    }
+    return kCount;
+}
+
+// Sets mergeCompression from array=level pairs like bwt=6,da=6,lcp=1,sl=1
+void parseCompression(char *arg){
+    int a;
+    char *token = strtok(arg, ",");
+    while(token != NULL){
+        char *level = strchr(token, '=');
+        for(a = 0; a < MERGE_ARRAYS && level != NULL; a++){
+            if(strncmp(token, mergeArrayNames[a], level-token) == 0 && mergeArrayNames[a][level-token] == '\0')
+                break;
+        }
+        if(level == NULL || a == MERGE_ARRAYS || atoi(level+1) < 0 || atoi(level+1) > 9){
+            printf("Invalid compression %s, it must be bwt, da, lcp or sl = a zlib level between 0 and 9\n", token);
+            exit(-1);
+        }
+        mergeCompression[a] = atoi(level+1);
+        token = strtok(NULL, ",");
+    }
+}
+
 char* getPathDirName(char *path, int len){
     if(path[len-1] == '/'){
         path[len-1] = '\0';
@@ -56,49 +101,294 @@ char* getPathDirName(char *path, int len){
     return dir;
 }
 
+// 1 if the BOSS files <outDir>/<name>_k_<k>.boss of every k value were built from the merge with key mergeKey
+int bossComputed(char *name, uint64_t mergeKey, int *kValues, int kCount, int samples, int minAbundance){
+    char bossFileName[FILE_PATH];
+    for(int x = 0; x < kCount; x++){
+        snprintf(bossFileName, FILE_PATH, "%s/%s_k_%d.boss", outDir, name, kValues[x]);
+        if(!manifestValid(bossFileName, bossKey(mergeKey, kValues[x], samples, minAbundance)))
+            return 0;
+    }
+    return 1;
+}
+
+// Reads the pairs of genome names (two per line) of pairsFile as positions of files, returns how many were read
+int readPairs(char *pairsFile, char **files, int numberOfFiles, int **pairs){
+    char name1[FILE_PATH], name2[FILE_PATH];
+    int i, count = 0, capacity = 64;
+    FILE *f = fopen(pairsFile, "r");
+    if(f == NULL){
+        fprintf(stderr, "Unable to read file %s\n", pairsFile);
+        exit(-1);
+    }
+    *pairs = (int*)malloc(2*capacity*sizeof(int));
+    while(fscanf(f, "%1023s %1023s", name1, name2) == 2){
+        int genome1 = -1, genome2 = -1;
+        for(i = 0; i < numberOfFiles; i++){
+            if(strcmp(files[i], name1) == 0) genome1 = i;
+            if(strcmp(files[i], name2) == 0) genome2 = i;
+        }
+        if(genome1 < 0 || genome2 < 0 || genome1 == genome2){
+            fprintf(stderr, "Invalid pair of genomes %s %s in %s\n", name1, name2, pairsFile);
+            exit(-1);
+        }
+        if(count == capacity){
+            capacity *= 2;
+            *pairs = (int*)realloc(*pairs, 2*capacity*sizeof(int));
+        }
+        (*pairs)[2*count] = MIN(genome1, genome2);
+        (*pairs)[2*count+1] = MAX(genome1, genome2);
+        count++;
+    }
+    fclose(f);
+    return count;
+}
+
+// Bytes of an input, times the expected compression ratio if it is compressed. An upper bound of its symbols
+uint64_t inputSize(char *path, char *file){
+    struct stat st;
+    char input[FILE_PATH];
+    snprintf(input, FILE_PATH, "%s%s", path, file);
+    if(stat(input, &st) != 0)
+        return 0;
+    return isCompressedFile(file) ? COMPRESSION_RATIO*(uint64_t)st.st_size : (uint64_t)st.st_size;
+}
+
+// Prints the estimated disk space needed in tmpDir and outDir, warning if it is more than is available
+void checkDiskSpace(uint64_t tmpBytes, uint64_t outBytes){
+    struct statvfs tmpFs, outFs;
+    struct stat tmpSt, outSt;
+    double gb = 1024.0*1024.0*1024.0;
+    if(statvfs(tmpDir, &tmpFs) != 0 || statvfs(outDir, &outFs) != 0 || stat(tmpDir, &tmpSt) != 0 || stat(outDir, &outSt) != 0)
+        return;
+    uint64_t tmpAvailable = (uint64_t)tmpFs.f_bavail*tmpFs.f_frsize;
+    uint64_t outAvailable = (uint64_t)outFs.f_bavail*outFs.f_frsize;
+
+    printf("Estimated disk space: %.2lf GB of eGap arrays in %s (%.2lf GB available), %.2lf GB of BOSS files in %s (%.2lf GB available)\n", tmpBytes/gb, tmpDir, tmpAvailable/gb, outBytes/gb, outDir, outAvailable/gb);
+    if(tmpSt.st_dev == outSt.st_dev){
+        if(tmpBytes+outBytes > tmpAvailable)
+            fprintf(stderr, "Warning: %s and %s may not have enough disk space (%.2lf GB needed)\n", tmpDir, outDir, (tmpBytes+outBytes)/gb);
+    } else {
+        if(tmpBytes > tmpAvailable)
+            fprintf(stderr, "Warning: %s may not have enough disk space (%.2lf GB needed)\n", tmpDir, tmpBytes/gb);
+        if(outBytes > outAvailable)
+            fprintf(stderr, "Warning: %s may not have enough disk space (%.2lf GB needed)\n", outDir, outBytes/gb);
+    }
+}
+
+// Builds the BOSS of every k value from the <tmpDir>/merge.<mergeName> arrays
+void constructBoss(char *mergeName, uint64_t mergeKey, int *kValues, int kCount, int samples, int memory, char *file1, char *file2, int printBoss, int minAbundance, int threads){
+    char mergeBWTFile[FILE_PATH];
+    char mergeLCPFile[FILE_PATH];
+    char mergeDAFile[FILE_PATH];
+    char mergeSLFile[FILE_PATH];
+
+    snprintf(mergeBWTFile, FILE_PATH, "%s/merge.%s.bwt", tmpDir, mergeName);
+    snprintf(mergeLCPFile, FILE_PATH, "%s/merge.%s.1.lcp", tmpDir, mergeName);
+    // merges of more than 256 genomes have 2 bytes genome ids
+    int daBytes = samples > 256 ? 2 : 1;
+    snprintf(mergeDAFile, FILE_PATH, "%s/merge.%s.%d.cda", tmpDir, mergeName, daBytes);
+    snprintf(mergeSLFile, FILE_PATH, "%s/merge.%s.1.sl", tmpDir, mergeName);
+
+    // the merged arrays may be chunk files
+    long length = chunkFileLength(mergeBWTFile);
+    if(length < 0){
+        printf("Unable to read file %s\n", mergeBWTFile);
+        exit(-1);
+    }
+    size_t n = length;
+
+    /******** Construct BOSS representation ********/
+    bossConstruction(mergeLCPFile, mergeDAFile, mergeBWTFile, mergeSLFile, n, kValues, kCount, samples, memory, file1, file2, printBoss, minAbundance, mergeKey, daBytes, threads);
+}
+
+// Answers the queries and writes the unitigs of the BOSS <outDir>/<name>_k_<k>, their metrics go to infoFile
+void bossTools(bossFile *boss, char **names, char *name, char *queryFile, int threads, int printUnitigs, FILE *infoFile){
+    int k = boss->header->k;
+    if(queryFile != NULL){
+        char queryResultsFileName[FILE_PATH];
+        phaseMetrics queryMetrics;
+        metricsStart(&queryMetrics, "Query");
+        queryMetrics.k = k;
+        snprintf(queryResultsFileName, FILE_PATH, "%s/%s_k_%d.query", outDir, name, k);
+        queryKmers(boss, names, queryFile, threads, queryResultsFileName);
+        metricsStop(&queryMetrics);
+        metricsPrint(infoFile, &queryMetrics);
+        printf("K-mers of %s queried, genomes of each one can be found in %s\n", queryFile, queryResultsFileName);
+    }
+    if(printUnitigs){
+        char unitigsFileName[FILE_PATH];
+        phaseMetrics unitigsMetrics;
+        metricsStart(&unitigsMetrics, "Unitigs");
+        unitigsMetrics.k = k;
+        snprintf(unitigsFileName, FILE_PATH, "%s/%s_k_%d.gfa", outDir, name, k);
+        size_t unitigs = writeUnitigs(boss, names, unitigsFileName);
+        metricsStop(&unitigsMetrics);
+        metricsPrint(infoFile, &unitigsMetrics);
+        printf("%zu unitigs written to %s\n", unitigs, unitigsFileName);
+    }
+}
+
+// Name of an option as given in the command line, -x or --name of the long options
+char* optionName(int option, struct option *longOptions){
+    static char name[FILE_PATH];
+    snprintf(name, FILE_PATH, "-%c", option);
+    for(struct option *o = longOptions; o->name != NULL; o++){
+        if(o->val == option)
+            snprintf(name, FILE_PATH, "--%s", o->name);
+    }
+    return name;
+}
+
+typedef struct {
+    double distance;
+    int genome1, genome2;
+} distancePair;
+
+static int compareDistancePairs(const void *a, const void *b){
+    const distancePair *x = (const distancePair*)a, *y = (const distancePair*)b;
+    if(x->distance != y->distance)
+        return x->distance < y->distance ? -1 : 1;
+    return x->genome1 != y->genome1 ? x->genome1 - y->genome1 : x->genome2 - y->genome2;
+}
+
+// Sorts the pairs (pairs[2*p] < pairs[2*p+1]) by distances[pairs[2*p+1]][pairs[2*p]], the nearest first
+void sortPairsByDistance(int *pairs, int pairCount, double **distances){
+    int p;
+    distancePair *sorted = (distancePair*)malloc(MAX(pairCount, 1)*sizeof(distancePair));
+    for(p = 0; p < pairCount; p++){
+        sorted[p].genome1 = pairs[2*p];
+        sorted[p].genome2 = pairs[2*p+1];
+        sorted[p].distance = distances[pairs[2*p+1]][pairs[2*p]];
+    }
+    qsort(sorted, pairCount, sizeof(distancePair), compareDistancePairs);
+    for(p = 0; p < pairCount; p++){
+        pairs[2*p] = sorted[p].genome1;
+        pairs[2*p+1] = sorted[p].genome2;
+    }
+    free(sorted);
+}
+
 int main(int argc, char *argv[]){
-    int i, j;
-    char **files = (char**)calloc(512, sizeof(char*));
-    int k = 32;
+    int i, j, x;
+    int filesCapacity = 512;
+    char **files = (char**)calloc(filesCapacity, sizeof(char*));
+    int kValues[MAX_K_VALUES] = { 32 };
+    int kCount = 1;
     int numberOfFiles = 0;
     char *path;
     int pathLen;
     int opt;
     int memory = 2048;
     int printBoss = 0;
+    int minAbundance = 1;
+    char *queryFile = NULL;
+    char *pairsFile = NULL;
+    int threads = 1;
+    int printUnitigs = 0;
+    int pairOfFiles = 0;
+    int sketchNearest = 0;
+    double sketchMaxDistance = -1;
+    int knn = 0;
 
     /******** Check arguments ********/
-    int validOpts = 0;
-    while ((opt = getopt (argc, argv, "pk:m:")) != -1){
+    int keepTmp = 0;
+    static struct option longOptions[] = {
+        {"tmp-dir", required_argument, NULL, 'T'},
+        {"out-dir", required_argument, NULL, 'O'},
+        {"keep-tmp", no_argument, NULL, 'K'},
+        {"pairs", required_argument, NULL, 'P'},
+        {"tmp-compression", required_argument, NULL, 'Z'},
+        {"sketch", required_argument, NULL, 'S'},
+        {"sketch-distance", required_argument, NULL, 'D'},
+        {"knn", required_argument, NULL, 'N'},
+        {NULL, 0, NULL, 0}
+    };
+    while ((opt = getopt_long (argc, argv, "puk:m:s:q:t:a:c:d:", longOptions, NULL)) != -1){
         switch (opt){
+            case 'T':
+                tmpDir = optarg;
+                break;
+            case 'O':
+                outDir = optarg;
+                break;
+            case 'K':
+                keepTmp = 1;
+                break;
+            case 'P':
+                pairsFile = optarg;
+                break;
+            case 'Z':
+                parseCompression(optarg);
+                break;
+            case 'S':
+                sketchNearest = atoi(optarg);
+                break;
+            case 'D':
+                sketchMaxDistance = atof(optarg);
+                break;
+            case 'N':
+                knn = atoi(optarg);
+                break;
             case 'p':
-                validOpts+=1;
                 printBoss = 1;
                 break;
+            case 'u':
+                printUnitigs = 1;
+                break;
             case 'k':
-                validOpts += 2;
-                k = atoi(optarg);
+                kCount = parseKValues(optarg, kValues);
                 break;
             case 'm':
-                validOpts += 2;
                 memory = atoi(optarg);
                 break;
+            case 's':
+                minAbundance = atoi(optarg);
+                break;
+            case 'q':
+                queryFile = optarg;
+                break;
+            case 't':
+                threads = atoi(optarg);
+                break;
+            case 'a':
+                runMode.allVsAll = atoi(optarg) != 0;
+                break;
+            case 'c':
+                runMode.coverage = atoi(optarg) != 0;
+                break;
+            case 'd':
+                runMode.debug = atoi(optarg) != 0;
+                break;
             case '?':
-                if(opt == 'k')
-                    fprintf (stderr, "Option -%c requires a integer value.\n", opt);
-                else if(opt == 'm')
-                    fprintf (stderr, "Option -%c requires a integer value.\n", opt);
-                else if (isprint (opt))
-                    fprintf (stderr, "Unknown option `-%c'.\n", opt);
+                // getopt returns '?' and leaves the option in optopt, 0 for an unknown long option
+                if(optopt == 'k')
+                    fprintf (stderr, "Option %s requires comma separated integer values.\n", optionName(optopt, longOptions));
+                else if(optopt != 0 && strchr("mstacdSN", optopt) != NULL)
+                    fprintf (stderr, "Option %s requires an integer value.\n", optionName(optopt, longOptions));
+                else if(optopt == 'D')
+                    fprintf (stderr, "Option %s requires a number.\n", optionName(optopt, longOptions));
+                else if(optopt == 'q' || optopt == 'P')
+                    fprintf (stderr, "Option %s requires a file.\n", optionName(optopt, longOptions));
+                else if(optopt == 'T' || optopt == 'O')
+                    fprintf (stderr, "Option %s requires a directory.\n", optionName(optopt, longOptions));
+                else if(optopt == 'Z')
+                    fprintf (stderr, "Option %s requires array=level values.\n", optionName(optopt, longOptions));
+                else if(optopt == 0)
+                    fprintf (stderr, "Unknown option `%s'.\n", argv[optind-1]);
+                else if (isprint (optopt))
+                    fprintf (stderr, "Unknown option `-%c'.\n", optopt);
                 else
-                    fprintf (stderr, "Unknown option character `\\x%x'.\n", opt);
+                    fprintf (stderr, "Unknown option character `\\x%x'.\n", optopt);
                 return 1;
             default:
                 abort ();
         }
     }
 
-    if(argc-validOpts == 2){
+    // getopt moves the arguments that are not options to the end
+    int arguments = argc-optind;
+    if(arguments == 1){
         DIR *folder;
         struct dirent *entry;
         int len;
@@ -112,10 +402,11 @@ int main(int argc, char *argv[]){
             exit(-1);
         }
         while((entry=readdir(folder)) != NULL){
-            char *isFastq = strstr(entry->d_name, ".fastq");
-            char *isFasta = strstr(entry->d_name, ".fasta");
-
-            if((isFastq && strlen(isFastq) == 6) || (isFasta && strlen(isFasta) == 6)){
+            if(isSequenceFile(entry->d_name)){
+                if(numberOfFiles == filesCapacity){
+                    filesCapacity *= 2;
+                    files = (char**)realloc(files, filesCapacity*sizeof(char*));
+                }
                 len = strlen(entry->d_name)+1;
                 files[numberOfFiles] = (char*)malloc((pathLen+len+2)*sizeof(char));
 
@@ -125,7 +416,7 @@ int main(int argc, char *argv[]){
         }
 
         closedir(folder);
-    } else if(argc-validOpts == 4){
+    } else if(arguments == 3){
         int fileLen;
         pathLen = strlen(argv[argc-3]);
         path = (char*)malloc((pathLen+1)*sizeof(char));
@@ -140,26 +431,32 @@ int main(int argc, char *argv[]){
         strncpy(files[1], argv[argc-1], fileLen+1);
         
         numberOfFiles = 2;
+        pairOfFiles = 1;
     } else {
         printf("Missing arguments!\n\n");
-        printf("To compute distance of all fastq files from a directory use command:\n");
+        printf("To compute distance of all fastq/fasta files (optionally .gz, .bz2, .xz or .zst) from a directory use command:\n");
         printf("./gcBB <path_to_dir> --options\n\n");
         printf("To compute distance of two fastq files use command:\n");
         printf("./gcBB <path_to_dir> <file1> <file2> --options\n\n");
         exit(-1);
     }
 
-    int systemTmp = system("mkdir tmp");
-    if(systemTmp == -1){
-        printf("Error creating tmp folder");
+    if(makeDirectory(tmpDir) != 0){
+        fprintf(stderr, "Unable to create directory %s\n", tmpDir);
+        exit(-1);
     }
-    int systemResults = system("mkdir results");
-    if(systemResults == -1){
-        printf("Error creating results folder");
+    if(makeDirectory(outDir) != 0){
+        fprintf(stderr, "Unable to create directory %s\n", outDir);
+        exit(-1);
     }
 
     qsort(files, numberOfFiles, sizeof(char*), compareFiles);
 
+    // artifacts of previous (or killed) runs with the same inputs and parameters are reused
+    char manifestFileName[FILE_PATH];
+    snprintf(manifestFileName, FILE_PATH, "%s/%s", tmpDir, MANIFEST_FILE);
+    manifestOpen(manifestFileName);
+
     /******** Check PSUTIL ********/
     int result = system("python3 -c \"import psutil\" 2>/dev/null");
     if (result != 0) {
@@ -169,14 +466,20 @@ int main(int argc, char *argv[]){
 
     /******** Compute external needed files ********/
     printf("=== PHASE 1 ===\n");
-    printf("Start computing SA, BWT and LCP for all files\n");
-    // Computes SA, BWT, LCP and DA from both files
+    phaseMetrics phase1;
+    metricsStart(&phase1, "Phase 1");
+
+    // keys of the arrays only depend on the content of the inputs, so they are known before computing anything
+    char *inputPath = path;
+    char **inputFiles = (char**)malloc(numberOfFiles*sizeof(char*));
+    uint64_t *fileKeys = (uint64_t*)malloc(numberOfFiles*sizeof(uint64_t));
+    uint64_t *inputSymbols = (uint64_t*)malloc(numberOfFiles*sizeof(uint64_t));
     for(i = 0; i < numberOfFiles; i++){
-        computeFile(path, files[i], memory);
+        inputFiles[i] = strdup(files[i]);
+        fileKeys[i] = fileKey(inputPath, files[i]);
+        inputSymbols[i] = inputSize(inputPath, files[i]);
     }
 
-    printf("All needed arrays computed!\n");
-
     // Remove file format from the string
     for(i = 0; i < numberOfFiles; i++){
         char *ptr;
@@ -185,160 +488,399 @@ int main(int argc, char *argv[]){
             *ptr = '\0';
     }
 
-    path = getPathDirName(path, pathLen);
+    path = getPathDirName(strdup(inputPath), pathLen);
+
+    // only the pairs of pairsFile are compared in the all-vs-all BOSS
+    int *pairs = NULL;
+    int pairCount = 0;
+    if(pairsFile != NULL){
+        if(runMode.allVsAll)
+            pairCount = readPairs(pairsFile, files, numberOfFiles, &pairs);
+        else
+            printf("--pairs is only used with -a 1, every pair is compared\n");
+    }
 
-    printf("Merging all pairs and computing document array (cda)\n");
+    /* only the pairs near by the sketches of the inputs are compared, the
+       distance of the others is estimated from their sketches */
+    char *exact = NULL;
+    double **sketchDistances = NULL;
+    if((sketchNearest > 0 || sketchMaxDistance >= 0) && !pairOfFiles && pairs == NULL){
+        phaseMetrics sketchMetrics;
+        metricsStart(&sketchMetrics, "Sketches");
+        int kmer = kValues[0];
+        for(x = 1; x < kCount; x++) kmer = MIN(kmer, kValues[x]);
+        kmer = MIN(kmer+1, SKETCH_KMER_MAX);
+
+        sketch **sketches = (sketch**)malloc(numberOfFiles*sizeof(sketch*));
+        for(i = 0; i < numberOfFiles; i++)
+            sketches[i] = computeSketch(inputPath, inputFiles[i], kmer);
+        sketchDistances = (double**)malloc(numberOfFiles*sizeof(double*));
+        for(i = 0; i < numberOfFiles; i++){
+            sketchDistances[i] = (double*)calloc(numberOfFiles, sizeof(double));
+            for(j = 0; j < i; j++)
+                sketchDistances[i][j] = sketchDistance(sketches[i], sketches[j]);
+        }
+        for(i = 0; i < numberOfFiles; i++) sketchFree(sketches[i]);
+        free(sketches);
+
+        exact = (char*)malloc(numberOfFiles*numberOfFiles*sizeof(char));
+        int exactCount = sketchCandidates(sketchDistances, numberOfFiles, sketchNearest, sketchMaxDistance, exact);
+        metricsStop(&sketchMetrics);
+        printf("%d of %d pairs near by their sketches (%d-mers) are compared, the others are estimated\n", exactCount, numberOfFiles*(numberOfFiles-1)/2, kmer);
+
+        // the all-vs-all BOSS compares them as a batch of pairs
+        if(runMode.allVsAll){
+            pairs = (int*)malloc(2*MAX(exactCount, 1)*sizeof(int));
+            for(i = 0; i < numberOfFiles; i++){
+                for(j = i+1; j < numberOfFiles; j++){
+                    if(exact[i*numberOfFiles+j]){
+                        pairs[2*pairCount] = i;
+                        pairs[2*pairCount+1] = j;
+                        pairCount++;
+                    }
+                }
+            }
+        }
+    } else if(sketchNearest > 0 || sketchMaxDistance >= 0){
+        printf("--sketch and --sketch-distance are not used with --pairs or a pair of files\n");
+    }
 
-    // Computes merge of files
-    #if ALL_VS_ALL
-        computeMergeFileAll(path, files, numberOfFiles, memory);
-    #else
+    /* bwsdAll has no bound, so with --knn the all-vs-all BOSS without
+       coverage compares every pair as a batch of pairs, which stop early */
+    if(knn > 0 && runMode.allVsAll && !runMode.coverage && pairs == NULL){
+        pairs = (int*)malloc(2*MAX(numberOfFiles*(numberOfFiles-1)/2, 1)*sizeof(int));
+        for(i = 0; i < numberOfFiles; i++){
+            for(j = i+1; j < numberOfFiles; j++){
+                pairs[2*pairCount] = i;
+                pairs[2*pairCount+1] = j;
+                pairCount++;
+            }
+        }
+    }
+    // the first pairs of each genome fill its neighbors, so the nearest by their sketches go first
+    if(knn > 0 && pairs != NULL && sketchDistances != NULL)
+        sortPairsByDistance(pairs, pairCount, sketchDistances);
+
+    // the all-vs-all BOSS is named after the directory, or after the pair of files compared
+    char collection[FILE_PATH];
+    if(pairOfFiles)
+        snprintf(collection, FILE_PATH, "%s-%s", files[0], files[1]);
+    else
+        snprintf(collection, FILE_PATH, "%s", path);
+
+    // a merge is only needed while the BOSS of some k is missing, merges of finished BOSS may have been removed
+    uint64_t *mergeKeys = (uint64_t*)malloc(numberOfFiles*numberOfFiles*sizeof(uint64_t));
+    char *needMerge = (char*)calloc(numberOfFiles*numberOfFiles, sizeof(char));
+    char *needFile = (char*)calloc(numberOfFiles, sizeof(char));
+    uint64_t tmpBytes = 0, outBytes = 0, largestMerge = 0;
+    if(runMode.allVsAll && !pairOfFiles){
+        uint64_t symbols = 0;
+        for(i = 0; i < numberOfFiles; i++) symbols += inputSymbols[i];
+        mergeKeys[0] = mergeFileAllKey(fileKeys, numberOfFiles);
+        if(!bossComputed(collection, mergeKeys[0], kValues, kCount, numberOfFiles, minAbundance)){
+            needMerge[0] = 1;
+            memset(needFile, 1, numberOfFiles);
+            tmpBytes += MERGE_ARRAYS_BYTES*symbols;
+            outBytes += kCount*BOSS_EDGE_BYTES*symbols;
+            largestMerge = symbols;
+        }
+    } else {
         for(i = 0; i < numberOfFiles; i++){
             for(j = i+1; j < numberOfFiles; j++){
-                computeMergeFiles(path, files[i], files[j], memory);
+                if(exact != NULL && !exact[i*numberOfFiles+j])
+                    continue;
+                char mergeName[FILE_PATH];
+                snprintf(mergeName, FILE_PATH, "%s-%s", files[i], files[j]);
+                uint64_t symbols = inputSymbols[i]+inputSymbols[j];
+                mergeKeys[i*numberOfFiles+j] = mergeFilesKey(fileKeys[i], fileKeys[j]);
+                if(!bossComputed(mergeName, mergeKeys[i*numberOfFiles+j], kValues, kCount, 2, minAbundance)){
+                    needMerge[i*numberOfFiles+j] = needFile[i] = needFile[j] = 1;
+                    // the pairwise engine removes each merge before the next one
+                    if(runMode.allVsAll || keepTmp)
+                        tmpBytes += MERGE_ARRAYS_BYTES*symbols;
+                    outBytes += kCount*BOSS_EDGE_BYTES*symbols;
+                    largestMerge = MAX(largestMerge, symbols);
+                }
             }
         }
-    #endif
+    }
+    uint64_t largestInput = 0;
+    for(i = 0; i < numberOfFiles; i++){
+        if(needFile[i]){
+            tmpBytes += FILE_ARRAYS_BYTES*inputSymbols[i];
+            largestInput = MAX(largestInput, inputSymbols[i]);
+        }
+    }
+    // the normalized FASTA of an input, the merge of a pair, and the BOSS sections of a BOSS while they are packed (or all of them with -p)
+    tmpBytes += largestInput;
+    if(!runMode.allVsAll && !keepTmp)
+        tmpBytes += MERGE_ARRAYS_BYTES*largestMerge;
+    outBytes += printBoss ? outBytes : BOSS_EDGE_BYTES*largestMerge;
+    checkDiskSpace(tmpBytes, outBytes);
+
+    printf("Start computing SA, BWT and LCP for all files\n");
+    // Computes SA, BWT, LCP and DA from both files
+    for(i = 0; i < numberOfFiles; i++){
+        if(!needFile[i])
+            continue;
+        phaseMetrics fileMetrics;
+        metricsStart(&fileMetrics, "eGap %s", files[i]);
+        computeFile(inputPath, inputFiles[i], fileKeys[i], memory);
+        metricsStop(&fileMetrics);
+    }
 
-    printf("All arrays merged\n");
+    printf("All needed arrays computed!\n");
 
-    // Similarity matrix based on expectation
-    double **Dm = (double**)malloc(numberOfFiles*sizeof(double*));
-    for(i = 0; i < numberOfFiles; i++)
-        Dm[i] = (double*)malloc(numberOfFiles*sizeof(double));
+    // Computes merge of files, the metrics of each merge also go to the .info files of its BOSS
+    phaseMetrics mergeMetrics;
+    if(runMode.allVsAll){
+        printf("Merging all files and computing document array (cda)\n");
+        metricsStart(&mergeMetrics, "eGap merge");
+        if(pairOfFiles && needMerge[1])
+            computeMergeFiles(path, files[0], files[1], mergeKeys[1], memory);
+        else if(!pairOfFiles && needMerge[0])
+            computeMergeFileAll(path, files, fileKeys, mergeKeys[0], numberOfFiles, memory, threads, keepTmp);
+        metricsStop(&mergeMetrics);
+        printf("All arrays merged\n");
+    }
 
-    // Similarity matrix based on shannons entropy
-    double **De = (double**)malloc(numberOfFiles*sizeof(double*));
-    for(i = 0; i < numberOfFiles; i++)
-        De[i] = (double*)malloc(numberOfFiles*sizeof(double));
+    metricsStop(&phase1);
 
-    // Initialize matrixes
-    for(i = 0; i < numberOfFiles; i++){
-        for(j = 0; j < numberOfFiles; j++){
-            Dm[i][j] = 0.0;
-            De[i][j] = 0.0;
+    // Similarity matrixes based on expectation, one per k
+    double ***Dm = (double***)malloc(kCount*sizeof(double**));
+    // Similarity matrixes based on shannons entropy, one per k
+    double ***De = (double***)malloc(kCount*sizeof(double**));
+    for(x = 0; x < kCount; x++){
+        Dm[x] = (double**)malloc(numberOfFiles*sizeof(double*));
+        De[x] = (double**)malloc(numberOfFiles*sizeof(double*));
+        // Initialize matrixes
+        for(i = 0; i < numberOfFiles; i++){
+            Dm[x][i] = (double*)calloc(numberOfFiles, sizeof(double));
+            De[x][i] = (double*)calloc(numberOfFiles, sizeof(double));
         }
     }
 
+    /* nearest genomes of each genome, one per k. A pair stops early once it
+       can not be among the nearest of either genome, as far as they are known */
+    bwsdNeighbors **neighbors = NULL;
+    if(knn > 0){
+        neighbors = (bwsdNeighbors**)malloc(kCount*sizeof(bwsdNeighbors*));
+        for(x = 0; x < kCount; x++)
+            neighbors[x] = bwsdNeighborsCreate(numberOfFiles, knn);
+    }
+
     printf("Start construction of colored BOSS and comparing genomes using BWSD for every pair\n");
-    
-    #if !ALL_VS_ALL
-    for(i = 0; i < numberOfFiles; i++){
-        for(j = i+1; j < numberOfFiles; j++){
-            printf("=== PHASE 2 [%d,%d] ===\n", i, j);
-    #else 
-        printf("=== PHASE 2 ===\n");
-    #endif
-    char mergeBWTFile[FILE_PATH];
-    char mergeLCPFile[FILE_PATH];
-    char mergeDAFile[FILE_PATH];
-    char mergeSLFile[FILE_PATH];
 
-    #if !ALL_VS_ALL
-        snprintf(mergeBWTFile, FILE_PATH, "tmp/merge.%s-%s.bwt", files[i], files[j]);
-        snprintf(mergeLCPFile, FILE_PATH, "tmp/merge.%s-%s.2.lcp", files[i], files[j]);
-        snprintf(mergeDAFile, FILE_PATH, "tmp/merge.%s-%s.1.cda", files[i], files[j]);
-        snprintf(mergeSLFile, FILE_PATH, "tmp/merge.%s-%s.2.sl", files[i], files[j]);
-    #else
-        snprintf(mergeBWTFile, FILE_PATH, "tmp/merge.%s.bwt", path);
-        snprintf(mergeLCPFile, FILE_PATH, "tmp/merge.%s.2.lcp", path);
-        snprintf(mergeDAFile, FILE_PATH, "tmp/merge.%s.1.cda", path);
-        snprintf(mergeSLFile, FILE_PATH, "tmp/merge.%s.2.sl", path);
-    #endif
-
-    FILE *mergeBWT = fopen(mergeBWTFile, "r");
-    FILE *mergeLCP = fopen(mergeLCPFile, "rb");
-    FILE *mergeDA = fopen(mergeDAFile, "rb");
-    FILE *mergeSL = fopen(mergeSLFile, "rb");
-
-    fseek(mergeBWT, 0, SEEK_END);
-    size_t n = ftell(mergeBWT);
-    rewind(mergeBWT);
+    if(runMode.allVsAll){
+        printf("=== PHASE 2 ===\n");
+        phaseMetrics phase2;
+        metricsStart(&phase2, "Phase 2");
+        int merge = pairOfFiles ? 1 : 0;
+        if(needMerge[merge])
+            constructBoss(collection, mergeKeys[merge], kValues, kCount, numberOfFiles, memory, collection, NULL, printBoss, minAbundance, threads);
+        else
+            printf("BOSS files of %s already computed\n", collection);
+        metricsStop(&phase2);
 
-    /******** Construct BOSS representation ********/
-    #if !ALL_VS_ALL
-        int samples = 2;
-    #else
-        int samples = numberOfFiles;
-    #endif
-
-    #if !ALL_VS_ALL
-        bossConstruction(mergeLCP, mergeDA, mergeBWT, mergeSL, n, k, samples, memory, files[i], files[j], printBoss);
-    #else
-        bossConstruction(mergeLCP, mergeDA, mergeBWT, mergeSL, n, k, samples, memory, path, NULL, printBoss);
-    #endif
-
-    fclose(mergeBWT);
-    fclose(mergeLCP);
-    fclose(mergeDA);
-    fclose(mergeSL);
-
-    #if ALL_VS_ALL
         printf("=== PHASE 3 ===\n");
-        #if COVERAGE
-            bwsdAll(path, numberOfFiles, k, memory, Dm, De);
-        #else 
-            bwsdAll(path, numberOfFiles, k, memory, Dm, De);
-        #endif
-    #endif
-
-    #if ALL_VS_ALL
-    printf("For more details check file: results/%s_k_%d.info\n", path, k);
-    #endif
-
-    #if !ALL_VS_ALL
-        printf("=== PHASE 3 [%d,%d] ===\n", i, j);
-        double expectation, entropy;
-        expectation = entropy = 0.0;
-        bwsd(files[i], files[j], k, &expectation, &entropy, memory, printBoss, 0, 1);            
-        Dm[j][i] = expectation;
-        De[j][i] = entropy;
-    #endif
-
-    #if !ALL_VS_ALL
-        printf("For more details check file: results/%s-%s_k_%d.info\n", files[i], files[j], k);
+        phaseMetrics phase3;
+        metricsStart(&phase3, "Phase 3");
+        for(x = 0; x < kCount; x++){
+            char bossFileName[FILE_PATH];
+            snprintf(bossFileName, FILE_PATH, "%s/%s_k_%d.boss", outDir, collection, kValues[x]);
+            bossFile *boss = bossFileOpen(bossFileName, 0);
+            if(boss == NULL){
+                printf("Unable to read BOSS file %s\n", bossFileName);
+                exit(-1);
+            }
+            if(pairs != NULL){
+                double *expectation = (double*)malloc(MAX(pairCount, 1)*sizeof(double));
+                double *entropy = (double*)malloc(MAX(pairCount, 1)*sizeof(double));
+                // the pairs stopped early by the neighbors are NAN
+                bwsdPairs(boss, collection, pairs, pairCount, expectation, entropy, neighbors != NULL ? neighbors[x] : NULL);
+                if(exact != NULL){
+                    for(i = 0; i < pairCount; i++){
+                        Dm[x][pairs[2*i+1]][pairs[2*i]] = expectation[i];
+                        De[x][pairs[2*i+1]][pairs[2*i]] = entropy[i];
+                    }
+                } else if(pairsFile != NULL){
+                    printPairDistances(collection, kValues[x], files, pairs, pairCount, expectation, entropy);
+                }
+                free(expectation);
+                free(entropy);
+            } else {
+                bwsdAll(boss, collection, memory, Dm[x], De[x], threads);
+                if(neighbors != NULL){
+                    for(i = 0; i < numberOfFiles; i++)
+                        for(j = i+1; j < numberOfFiles; j++)
+                            bwsdNeighborsAdd(neighbors[x], i, j, Dm[x][j][i], De[x][j][i]);
+                }
+            }
+            FILE *infoFile = getInfoFile(collection, NULL, kValues[x], 1);
+            metricsPrint(infoFile, &mergeMetrics);
+            bossTools(boss, files, collection, queryFile, threads, printUnitigs, infoFile);
+            fclose(infoFile);
+            bossFileClose(boss);
+            printf("For more details check file: %s/%s_k_%d.info\n", outDir, collection, kValues[x]);
         }
-    }
-    #endif
+        // the merge is not needed anymore, it is named after the collection too
+        if(!keepTmp){
+            char mergeFilesName[FILE_PATH];
+            snprintf(mergeFilesName, FILE_PATH, "merge.%s", collection);
+            removeEGapOutputs(mergeFilesName, mergeKeys[merge]);
+        }
+        metricsStop(&phase3);
 
-    #if !ALL_VS_ALL
-        printf("All genome pairs constructed and compared\n\n");
-    #else
         printf("All genomes constructed and compared\n\n");
-    #endif
-
-    #if ALL_VS_ALL
-    if(!printBoss){
-        char colorFileName[FILE_PATH];
-        char summarizedLCPFileName[FILE_PATH];
-        char summarizedSLFileName[FILE_PATH];
-        char coverageFileName[FILE_PATH];
-        snprintf(colorFileName, FILE_PATH, "results/%s_k_%d.2.colors", path, k);
-        snprintf(summarizedLCPFileName, FILE_PATH, "results/%s_k_%d.2.summarizedLCP", path, k);
-        snprintf(summarizedSLFileName, FILE_PATH, "results/%s_k_%d.2.summarizedSL", path, k);
-        snprintf(coverageFileName, FILE_PATH, "results/%s_k_%d.4.coverage", path, k);
-        remove(colorFileName);
-        remove(summarizedLCPFileName);
-        remove(summarizedSLFileName);
-        remove(coverageFileName);
-    }
-    #endif
-
-    // Print BWSD results in files .dmat and .nhx
-    printDistanceMatrixes(Dm, De, files, numberOfFiles, path, k);
-
-    printf("All distance matrixes and newick files can be found in results folder\n");
+    } else {
+        // each pair is merged, constructed and compared before the next one is merged, so at most one merge is on disk
+        for(i = 0; i < numberOfFiles; i++){
+            for(j = i+1; j < numberOfFiles; j++){
+                if(exact != NULL && !exact[i*numberOfFiles+j])
+                    continue;
+                char mergeName[FILE_PATH];
+                snprintf(mergeName, FILE_PATH, "%s-%s", files[i], files[j]);
+                metricsStart(&mergeMetrics, "eGap merge");
+                if(needMerge[i*numberOfFiles+j])
+                    computeMergeFiles(path, files[i], files[j], mergeKeys[i*numberOfFiles+j], memory);
+                metricsStop(&mergeMetrics);
+
+                printf("=== PHASE 2 [%d,%d] ===\n", i, j);
+                phaseMetrics phase2;
+                metricsStart(&phase2, "Phase 2 %s-%s", files[i], files[j]);
+                if(needMerge[i*numberOfFiles+j])
+                    constructBoss(mergeName, mergeKeys[i*numberOfFiles+j], kValues, kCount, 2, memory, files[i], files[j], printBoss, minAbundance, threads);
+                else
+                    printf("BOSS files of %s already computed\n", mergeName);
+                metricsStop(&phase2);
+
+                printf("=== PHASE 3 [%d,%d] ===\n", i, j);
+                phaseMetrics phase3;
+                metricsStart(&phase3, "Phase 3 %s-%s", files[i], files[j]);
+                for(x = 0; x < kCount; x++){
+                    double expectation, entropy;
+                    expectation = entropy = 0.0;
+                    char bossFileName[FILE_PATH];
+                    snprintf(bossFileName, FILE_PATH, "%s/%s-%s_k_%d.boss", outDir, files[i], files[j], kValues[x]);
+                    bossFile *boss = bossFileOpen(bossFileName, 0);
+                    if(boss == NULL){
+                        printf("Unable to read BOSS file %s\n", bossFileName);
+                        exit(-1);
+                    }
+                    // the BWSD of pairs finished by a killed run is not computed again
+                    char bwsdValue[FILE_PATH];
+                    uint64_t bwsdKey = manifestKey("BWSD %016lx coverage %d", bossKey(mergeKeys[i*numberOfFiles+j], kValues[x], 2, minAbundance), runMode.coverage);
+                    if(manifestValue(bossFileName, bwsdKey, bwsdValue, FILE_PATH) && sscanf(bwsdValue, "%lf,%lf", &expectation, &entropy) == 2){
+                        printf("BWSD of %s and %s for k = %d already computed\n", files[i], files[j], kValues[x]);
+                        if(neighbors != NULL)
+                            bwsdNeighborsAdd(neighbors[x], i, j, expectation, entropy);
+                    } else {
+                        double bound = neighbors != NULL ? bwsdNeighborsBound(neighbors[x], i, j) : INFINITY;
+                        // a pair stopped early may be needed by a later run with other neighbors, it is not kept
+                        if(!bwsd(boss, files[i], files[j], &expectation, &entropy, memory, printBoss, 0, 1, bound)){
+                            snprintf(bwsdValue, FILE_PATH, "%.17g,%.17g", expectation, entropy);
+                            manifestSetValue(bossFileName, bwsdKey, bwsdValue);
+                            if(neighbors != NULL)
+                                bwsdNeighborsAdd(neighbors[x], i, j, expectation, entropy);
+                        }
+                    }
+                    FILE *infoFile = getInfoFile(files[i], files[j], kValues[x], 1);
+                    metricsPrint(infoFile, &mergeMetrics);
+                    char *pairFiles[2] = {files[i], files[j]};
+                    bossTools(boss, pairFiles, mergeName, queryFile, threads, printUnitigs, infoFile);
+                    fclose(infoFile);
+                    bossFileClose(boss);
+                    Dm[x][j][i] = expectation;
+                    De[x][j][i] = entropy;
+                    printf("For more details check file: %s/%s-%s_k_%d.info\n", outDir, files[i], files[j], kValues[x]);
+                }
+                // the merge of the pair is not needed anymore
+                if(!keepTmp){
+                    char mergeFilesName[FILE_PATH];
+                    snprintf(mergeFilesName, FILE_PATH, "merge.%s", mergeName);
+                    removeEGapOutputs(mergeFilesName, mergeKeys[i*numberOfFiles+j]);
+                }
+                metricsStop(&phase3);
+            }
+        }
+
+        printf("All genome pairs constructed and compared\n\n");
+    }
+    free(mergeKeys);
+    free(needMerge);
+    free(needFile);
+    free(fileKeys);
+    free(inputSymbols);
+    for(i = 0; i < numberOfFiles; i++) free(inputFiles[i]);
+    free(inputFiles);
+
+    // Print the nearest genomes of each genome, instead of the whole distance matrixes
+    if(neighbors != NULL){
+        for(x = 0; x < kCount; x++){
+            printNeighbors(runMode.allVsAll ? collection : path, kValues[x], files, neighbors[x]);
+            bwsdNeighborsFree(neighbors[x]);
+        }
+        free(neighbors);
+
+        printf("Nearest genomes of each genome (.knn files) can be found in %s\n", outDir);
+    }
+
+    // Print BWSD results in files .dmat and .nhx, unless only some pairs were compared
+    else if(pairs == NULL || exact != NULL){
+        for(x = 0; x < kCount; x++){
+            if(exact != NULL){
+                sketchFill(Dm[x], sketchDistances, numberOfFiles, exact);
+                sketchFill(De[x], sketchDistances, numberOfFiles, exact);
+            }
+            phaseMetrics distanceMetrics;
+            metricsStart(&distanceMetrics, "Distance matrixes");
+            distanceMetrics.k = kValues[x];
+            printDistanceMatrixes(Dm[x], De[x], files, numberOfFiles, path, kValues[x]);
+            if(exact != NULL)
+                printEstimatedPairs(path, kValues[x], files, numberOfFiles, exact, Dm[x], De[x]);
+            metricsStop(&distanceMetrics);
+        }
+
+        printf("All distance matrixes and newick files can be found in %s\n", outDir);
+    }
+    free(pairs);
+    free(exact);
+    if(sketchDistances != NULL){
+        for(i = 0; i < numberOfFiles; i++) free(sketchDistances[i]);
+        free(sketchDistances);
+    }
+
+    // Wall time, CPU, peak RSS and I/O of every phase
+    char metricsFileName[FILE_PATH];
+    snprintf(metricsFileName, FILE_PATH, "%s/%s", outDir, path);
+    if(runMode.coverage)
+        strcat(metricsFileName, "_cov");
+    if(runMode.allVsAll)
+        strcat(metricsFileName, "_all");
+    strcat(metricsFileName, "_metrics.json");
+    if(metricsWriteJson(metricsFileName) != 0)
+        fprintf(stderr, "Unable to write file %s\n", metricsFileName);
+    else
+        printf("Metrics of every phase can be found in %s\n", metricsFileName);
+    metricsFree();
+    manifestClose();
 
     // Free variables
-    for(i = 0; i < 512; i++) free(files[i]);
+    for(i = 0; i < numberOfFiles; i++) free(files[i]);
     free(files);
 
-    for(i = 0; i < numberOfFiles; i++) free(Dm[i]);
+    for(x = 0; x < kCount; x++){
+        for(i = 0; i < numberOfFiles; i++){
+            free(Dm[x][i]);
+            free(De[x][i]);
+        }
+        free(Dm[x]);
+        free(De[x]);
+    }
     free(Dm);
-
-    for(i = 0; i < numberOfFiles; i++) free(De[i]);
     free(De);
 
     free(path);
+    free(inputPath);
 }
 
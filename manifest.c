@@ -0,0 +1,252 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include "manifest.h"
+#include "bossfile.h"
+
+#define FILE_PATH 1024
+#define HASH_BUFFER (1 << 20)
+
+typedef struct {
+    char type; // 'I' input, 'F' file or 'V' value
+    uint64_t key; // content hash of an input
+    uint64_t size;
+    long mtime, mtimeNsec;
+    char *name;
+    char *value;
+} manifestEntry;
+
+static manifestEntry *entries = NULL;
+static size_t entryCount = 0, entryCapacity = 0;
+
+// open addressing table of entry positions+1 by type and name
+static size_t *table = NULL;
+static size_t tableSize = 0;
+
+static FILE *manifestLog = NULL;
+
+static uint64_t entryHash(char type, const char *name){
+    return bossChecksum(bossChecksum(BOSS_CHECKSUM_START, &type, 1), name, strlen(name));
+}
+
+static long findEntry(char type, const char *name){
+    if(tableSize == 0)
+        return -1;
+    size_t slot = entryHash(type, name) & (tableSize-1);
+    while(table[slot] != 0){
+        manifestEntry *e = &entries[table[slot]-1];
+        if(e->type == type && strcmp(e->name, name) == 0)
+            return table[slot]-1;
+        slot = (slot+1) & (tableSize-1);
+    }
+    return -1;
+}
+
+static void insertSlot(size_t position){
+    size_t slot = entryHash(entries[position].type, entries[position].name) & (tableSize-1);
+    while(table[slot] != 0)
+        slot = (slot+1) & (tableSize-1);
+    table[slot] = position+1;
+}
+
+// Adds e, or replaces the entry with the same type and name. e owns its strings afterwards
+static manifestEntry* putEntry(manifestEntry *e){
+    size_t i;
+    long position = findEntry(e->type, e->name);
+    if(position >= 0){
+        free(entries[position].name);
+        free(entries[position].value);
+        entries[position] = *e;
+        return &entries[position];
+    }
+
+    if(entryCount == entryCapacity){
+        entryCapacity = entryCapacity ? 2*entryCapacity : 256;
+        entries = realloc(entries, entryCapacity*sizeof(manifestEntry));
+    }
+    entries[entryCount++] = *e;
+
+    if(2*entryCount > tableSize){
+        free(table);
+        tableSize = tableSize ? 2*tableSize : 1024;
+        table = calloc(tableSize, sizeof(size_t));
+        for(i = 0; i < entryCount; i++)
+            insertSlot(i);
+    } else {
+        insertSlot(entryCount-1);
+    }
+    return &entries[entryCount-1];
+}
+
+static void writeEntry(FILE *f, manifestEntry *e){
+    if(e->type == 'I')
+        fprintf(f, "I %016lx %lu %ld %ld %s\n", e->key, e->size, e->mtime, e->mtimeNsec, e->name);
+    else if(e->type == 'F')
+        fprintf(f, "F %016lx %lu %s\n", e->key, e->size, e->name);
+    else
+        fprintf(f, "V %016lx %s %s\n", e->key, e->value, e->name);
+}
+
+// Appends e to the manifest, flushed so it survives the process being killed
+static void logEntry(manifestEntry *e){
+    if(manifestLog == NULL)
+        return;
+    writeEntry(manifestLog, e);
+    fflush(manifestLog);
+}
+
+static int parseEntry(char *line, manifestEntry *e){
+    unsigned long key, size;
+    char value[FILE_PATH];
+    int offset = 0;
+    size_t len = strlen(line);
+
+    // the last line of a killed run may be incomplete
+    if(len == 0 || line[len-1] != '\n')
+        return 0;
+    line[len-1] = '\0';
+
+    memset(e, 0, sizeof(manifestEntry));
+    e->type = line[0];
+    if(e->type == 'I' && sscanf(line, "I %lx %lu %ld %ld %n", &key, &size, &e->mtime, &e->mtimeNsec, &offset) == 4 && offset > 0){
+        e->key = key;
+        e->size = size;
+    } else if(e->type == 'F' && sscanf(line, "F %lx %lu %n", &key, &size, &offset) == 2 && offset > 0){
+        e->key = key;
+        e->size = size;
+    } else if(e->type == 'V' && sscanf(line, "V %lx %1023s %n", &key, value, &offset) == 2 && offset > 0){
+        e->key = key;
+        e->value = strdup(value);
+    } else {
+        return 0;
+    }
+    e->name = strdup(line+offset);
+    return 1;
+}
+
+void manifestOpen(const char *fileName){
+    size_t i;
+    char *line = NULL;
+    size_t capacity = 0;
+    manifestEntry e;
+
+    FILE *f = fopen(fileName, "r");
+    if(f != NULL){
+        while(getline(&line, &capacity, f) != -1){
+            if(parseEntry(line, &e))
+                putEntry(&e);
+        }
+        fclose(f);
+        free(line);
+    }
+
+    // rewrite it without the replaced lines, then keep appending to it
+    char partName[FILE_PATH];
+    snprintf(partName, FILE_PATH, "%s.part", fileName);
+    FILE *compacted = fopen(partName, "w");
+    if(compacted != NULL){
+        for(i = 0; i < entryCount; i++)
+            writeEntry(compacted, &entries[i]);
+        if(fclose(compacted) != 0 || rename(partName, fileName) != 0)
+            remove(partName);
+    }
+
+    manifestLog = fopen(fileName, "a");
+    if(manifestLog == NULL)
+        fprintf(stderr, "Unable to write file %s, artifacts of this run will not be reused\n", fileName);
+}
+
+void manifestClose(){
+    size_t i;
+    if(manifestLog != NULL)
+        fclose(manifestLog);
+    manifestLog = NULL;
+
+    for(i = 0; i < entryCount; i++){
+        free(entries[i].name);
+        free(entries[i].value);
+    }
+    free(entries);
+    free(table);
+    entries = NULL;
+    table = NULL;
+    entryCount = entryCapacity = tableSize = 0;
+}
+
+uint64_t manifestHashFile(const char *fileName){
+    struct stat st;
+    if(stat(fileName, &st) != 0)
+        return 0;
+
+    long position = findEntry('I', fileName);
+    if(position >= 0){
+        manifestEntry *cached = &entries[position];
+        if(cached->size == (uint64_t)st.st_size && cached->mtime == st.st_mtim.tv_sec && cached->mtimeNsec == st.st_mtim.tv_nsec)
+            return cached->key;
+    }
+
+    FILE *f = fopen(fileName, "rb");
+    if(f == NULL)
+        return 0;
+    char *buffer = malloc(HASH_BUFFER);
+    uint64_t hash = BOSS_CHECKSUM_START;
+    size_t bytes;
+    while((bytes = fread(buffer, 1, HASH_BUFFER, f)) > 0)
+        hash = bossChecksum(hash, buffer, bytes);
+    free(buffer);
+    fclose(f);
+
+    manifestEntry e = { 'I', hash, st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, strdup(fileName), NULL };
+    logEntry(putEntry(&e));
+    return hash;
+}
+
+uint64_t manifestKey(const char *format, ...){
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    char *parameters = malloc(len+1);
+    va_start(args, format);
+    vsnprintf(parameters, len+1, format, args);
+    va_end(args);
+
+    uint64_t key = bossChecksum(BOSS_CHECKSUM_START, GCBB_VERSION "\n", strlen(GCBB_VERSION)+1);
+    key = bossChecksum(key, parameters, len);
+    free(parameters);
+    return key;
+}
+
+int manifestValid(const char *fileName, uint64_t key){
+    struct stat st;
+    long position = findEntry('F', fileName);
+    if(position < 0 || entries[position].key != key)
+        return 0;
+    return stat(fileName, &st) == 0 && (uint64_t)st.st_size == entries[position].size;
+}
+
+int manifestCommit(const char *partName, const char *fileName, uint64_t key){
+    struct stat st;
+    if(rename(partName, fileName) != 0 || stat(fileName, &st) != 0)
+        return -1;
+
+    manifestEntry e = { 'F', key, st.st_size, 0, 0, strdup(fileName), NULL };
+    logEntry(putEntry(&e));
+    return 0;
+}
+
+int manifestValue(const char *name, uint64_t key, char *value, int size){
+    long position = findEntry('V', name);
+    if(position < 0 || entries[position].key != key)
+        return 0;
+    snprintf(value, size, "%s", entries[position].value);
+    return 1;
+}
+
+void manifestSetValue(const char *name, uint64_t key, const char *value){
+    manifestEntry e = { 'V', key, 0, 0, 0, strdup(name), strdup(value) };
+    logEntry(putEntry(&e));
+}
@@ -0,0 +1,48 @@
+#ifndef MANIFEST_H
+#define MANIFEST_H
+
+#include <stdint.h>
+
+// changes whenever an artifact (eGap arrays, BOSS file, BWSD values) is computed differently, so older ones are not reused
+#define GCBB_VERSION "gcBB-2"
+
+// kept in the tmp directory
+#define MANIFEST_FILE "gcBB.manifest"
+
+/* Manifest of the artifacts of previous runs, an append-only log so a
+   killed run loses at most the artifact being computed. Lines are
+     I <hash> <size> <mtime s> <mtime ns> <path>   content hash of an input
+     F <key> <size> <path>                         file committed with key
+     V <key> <value> <name>                        value computed with key
+   and a later line of the same path or name replaces an earlier one.
+
+   Artifacts are written to a .part file and renamed to their name once
+   complete (manifestCommit), so a file of the manifest is never partial.
+   The key of an artifact is a hash of GCBB_VERSION, the parameters that
+   change it and the keys of the artifacts (or inputs) it comes from.
+ */
+
+// Loads (and compacts) the manifest, the artifacts computed afterwards are appended to it
+void manifestOpen(const char *fileName);
+
+void manifestClose();
+
+// FNV-1a of the content of fileName, cached by size and modification time. 0 if it can not be read
+uint64_t manifestHashFile(const char *fileName);
+
+// Hash of GCBB_VERSION and the parameters in format
+uint64_t manifestKey(const char *format, ...);
+
+// 1 if fileName was committed with key and still has the same size
+int manifestValid(const char *fileName, uint64_t key);
+
+// Renames partName to fileName and records it with key. Returns 0 on success
+int manifestCommit(const char *partName, const char *fileName, uint64_t key);
+
+// Copies the value stored for name with key (at most size bytes), returns 1 if there is one
+int manifestValue(const char *name, uint64_t key, char *value, int size);
+
+// Stores value (without spaces) for name with key
+void manifestSetValue(const char *name, uint64_t key, const char *value);
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "metrics.h"
+
+#define MAX_RUNNING_PHASES 16
+
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+// phases between metricsStart and metricsStop, innermost last
+static phaseMetrics *running[MAX_RUNNING_PHASES];
+static int runningCount = 0;
+
+// stopped phases, written by metricsWriteJson
+static phaseMetrics *stopped = NULL;
+static size_t stoppedCount = 0, stoppedCapacity = 0;
+
+static double seconds(struct timeval t){
+    return t.tv_sec + t.tv_usec/1e6;
+}
+
+// rchar and wchar of /proc/self/io, left as 0 where it is not available
+static void readIO(uint64_t *bytesRead, uint64_t *bytesWritten){
+    char line[256];
+    unsigned long long value;
+    *bytesRead = *bytesWritten = 0;
+    FILE *io = fopen("/proc/self/io", "r");
+    if(io == NULL)
+        return;
+    while(fgets(line, sizeof(line), io) != NULL){
+        if(sscanf(line, "rchar: %llu", &value) == 1)
+            *bytesRead = value;
+        else if(sscanf(line, "wchar: %llu", &value) == 1)
+            *bytesWritten = value;
+    }
+    fclose(io);
+}
+
+void metricsStart(phaseMetrics *m, const char *format, ...){
+    va_list args;
+    memset(m, 0, sizeof(phaseMetrics));
+    va_start(args, format);
+    vsnprintf(m->name, METRICS_NAME, format, args);
+    va_end(args);
+
+    m->depth = runningCount;
+    if(runningCount < MAX_RUNNING_PHASES)
+        running[runningCount] = m;
+    runningCount++;
+
+    readIO(&m->readStart, &m->writtenStart);
+    getrusage(RUSAGE_SELF, &m->usageStart);
+    clock_gettime(CLOCK_MONOTONIC, &m->wallStart);
+}
+
+void metricsStop(phaseMetrics *m){
+    struct timespec wallEnd;
+    struct rusage usage;
+    uint64_t bytesRead, bytesWritten;
+
+    clock_gettime(CLOCK_MONOTONIC, &wallEnd);
+    getrusage(RUSAGE_SELF, &usage);
+    readIO(&bytesRead, &bytesWritten);
+
+    m->wallTime = (wallEnd.tv_sec - m->wallStart.tv_sec) + (wallEnd.tv_nsec - m->wallStart.tv_nsec)/1e9;
+    m->cpuTime = seconds(usage.ru_utime) + seconds(usage.ru_stime) - seconds(m->usageStart.ru_utime) - seconds(m->usageStart.ru_stime);
+    m->peakRSS = usage.ru_maxrss;
+    m->bytesRead = bytesRead - m->readStart;
+    m->bytesWritten = bytesWritten - m->writtenStart;
+
+    // phases are stopped in the reverse order they were started
+    if(runningCount > 0)
+        runningCount--;
+
+    if(stoppedCount == stoppedCapacity){
+        stoppedCapacity = stoppedCapacity ? 2*stoppedCapacity : 64;
+        stopped = realloc(stopped, stoppedCapacity*sizeof(phaseMetrics));
+    }
+    stopped[stoppedCount++] = *m;
+}
+
+// the resource usage of a child goes to every running phase
+static void addChildUsage(struct rusage *usage){
+    int i;
+    for(i = 0; i < runningCount && i < MAX_RUNNING_PHASES; i++){
+        phaseMetrics *m = running[i];
+        m->children++;
+        m->childCpuTime += seconds(usage->ru_utime) + seconds(usage->ru_stime);
+        m->childPeakRSS = MAX(m->childPeakRSS, usage->ru_maxrss);
+        m->childBytesRead += (uint64_t)usage->ru_inblock*512;
+        m->childBytesWritten += (uint64_t)usage->ru_oublock*512;
+    }
+}
+
+static pid_t spawnShell(const char *command){
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if(pid == 0){
+        execl("/bin/sh", "sh", "-c", command, (char*)NULL);
+        _exit(127);
+    }
+    return pid;
+}
+
+int metricsSystem(const char *command){
+    int status;
+    struct rusage usage;
+
+    pid_t pid = spawnShell(command);
+    if(pid == -1)
+        return -1;
+    while(wait4(pid, &status, 0, &usage) == -1){
+        if(errno != EINTR)
+            return -1;
+    }
+    addChildUsage(&usage);
+
+    return status;
+}
+
+int metricsSystemAll(char **commands, int *statuses, int count, int parallel){
+    int i, status, started = 0, finished = 0, failed = 0;
+    struct rusage usage;
+    pid_t *pids = malloc(count*sizeof(pid_t));
+    if(parallel < 1) parallel = 1;
+    for(i = 0; i < count; i++) statuses[i] = -1;
+
+    while(finished < count){
+        while(started < count && started-finished < parallel){
+            pids[started] = spawnShell(commands[started]);
+            if(pids[started] == -1){
+                failed++;
+                finished++;
+            }
+            started++;
+        }
+        if(started == finished)
+            continue;
+
+        pid_t pid = wait4(-1, &status, 0, &usage);
+        if(pid == -1){
+            if(errno == EINTR)
+                continue;
+            failed += count-finished;
+            break;
+        }
+        for(i = 0; i < started; i++){
+            if(pids[i] == pid){
+                statuses[i] = status;
+                if(!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+                    failed++;
+                addChildUsage(&usage);
+                finished++;
+                break;
+            }
+        }
+    }
+
+    free(pids);
+    return failed;
+}
+
+void metricsPrint(FILE *infoFile, phaseMetrics *m){
+    fprintf(infoFile, "%s time: %lf seconds (wall), %lf seconds (CPU)\n", m->name, m->wallTime, m->cpuTime);
+    fprintf(infoFile, "%s peak RSS: %ld KB\n", m->name, m->peakRSS);
+    fprintf(infoFile, "%s I/O: %lu bytes read, %lu bytes written\n", m->name, m->bytesRead, m->bytesWritten);
+    if(m->children > 0){
+        fprintf(infoFile, "%s child processes: %d, %lf seconds (CPU), %ld KB peak RSS, %lu bytes read, %lu bytes written\n", m->name, m->children, m->childCpuTime, m->childPeakRSS, m->childBytesRead, m->childBytesWritten);
+    }
+}
+
+static void printJsonString(FILE *json, const char *s){
+    fputc('"', json);
+    for(; *s; s++){
+        if(*s == '"' || *s == '\\')
+            fputc('\\', json);
+        if((unsigned char)*s >= 0x20)
+            fputc(*s, json);
+    }
+    fputc('"', json);
+}
+
+int metricsWriteJson(const char *fileName){
+    size_t i;
+    FILE *json = fopen(fileName, "w");
+    if(json == NULL)
+        return -1;
+
+    fprintf(json, "{\n  \"phases\": [\n");
+    for(i = 0; i < stoppedCount; i++){
+        phaseMetrics *m = &stopped[i];
+        fprintf(json, "    {\"name\": ");
+        printJsonString(json, m->name);
+        if(m->k > 0)
+            fprintf(json, ", \"k\": %d", m->k);
+        fprintf(json, ", \"depth\": %d, \"wall_seconds\": %lf, \"cpu_seconds\": %lf, \"peak_rss_kb\": %ld, \"bytes_read\": %lu, \"bytes_written\": %lu", m->depth, m->wallTime, m->cpuTime, m->peakRSS, m->bytesRead, m->bytesWritten);
+        fprintf(json, ", \"children\": {\"count\": %d, \"cpu_seconds\": %lf, \"peak_rss_kb\": %ld, \"bytes_read\": %lu, \"bytes_written\": %lu}}", m->children, m->childCpuTime, m->childPeakRSS, m->childBytesRead, m->childBytesWritten);
+        fprintf(json, "%s\n", i+1 < stoppedCount ? "," : "");
+    }
+    fprintf(json, "  ]\n}\n");
+
+    return fclose(json);
+}
+
+void metricsFree(){
+    free(stopped);
+    stopped = NULL;
+    stoppedCount = stoppedCapacity = 0;
+}
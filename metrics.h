@@ -0,0 +1,61 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define METRICS_NAME 128
+
+/* Resources used by a phase (or a sub-step of one) of gcBB.
+
+   Times and I/O are the difference between metricsStart and metricsStop.
+   CPU time is the user+system time of every thread of gcBB, bytes read
+   and written are the ones of read/write calls (/proc/self/io, so mmap
+   accesses are not counted) and peakRSS is the peak resident set of gcBB
+   so far. Child processes started with metricsSystem (eGap, nj) while
+   the phase is running are accounted for separately, from wait4.
+ */
+typedef struct {
+    char name[METRICS_NAME];
+    int depth; // number of phases running when this one started
+    int k; // k value of the BOSS the phase works on, 0 if it is not specific to one
+    double wallTime;
+    double cpuTime;
+    long peakRSS; // KB
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    int children;
+    double childCpuTime;
+    long childPeakRSS; // KB
+    uint64_t childBytesRead; // block I/O of the children
+    uint64_t childBytesWritten;
+    // state when the phase started
+    struct timespec wallStart;
+    struct rusage usageStart;
+    uint64_t readStart, writtenStart;
+} phaseMetrics;
+
+void metricsStart(phaseMetrics *m, const char *format, ...);
+
+// Stops m and adds it to the metrics of the run
+void metricsStop(phaseMetrics *m);
+
+// system() replacement, the child resource usage goes to every running phase
+int metricsSystem(const char *command);
+
+/* Runs commands[0..count-1] with metricsSystem, at most parallel at a time,
+   storing the wait status of each one in statuses. Returns the number of
+   commands that did not exit with 0 */
+int metricsSystemAll(char **commands, int *statuses, int count, int parallel);
+
+// Writes the metrics of m to an .info file, one line per resource
+void metricsPrint(FILE *infoFile, phaseMetrics *m);
+
+// Writes every stopped phase, in stop order, to a JSON file. Returns 0 on success
+int metricsWriteJson(const char *fileName);
+
+void metricsFree();
+
+#endif
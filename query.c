@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "query.h"
+#include "graph.h"
+#include "input.h"
+#include "external.h"
+
+#define FILE_PATH 1024
+#define QUERY_BATCH (1 << 20)
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+
+typedef struct {
+    char *kmer;
+    size_t index; // position in the batch
+} query;
+
+typedef struct {
+    bossGraph *g;
+    query *queries;
+    size_t start, end;
+    uint64_t *found; // genomes of each query, words bits per query
+    int words;
+} queryWorker;
+
+static int compareQueries(const void *element1, const void *element2){
+    query *q1 = (query*)element1;
+    query *q2 = (query*)element2;
+    return strcmp(q1->kmer, q2->kmer);
+}
+
+/* Queries are sorted, so the vertex range of the prefix shared with the
+   previous query is reused and only the remaining symbols are extended */
+static void* queryWorkerRun(void *arg){
+    queryWorker *w = (queryWorker*)arg;
+    bossGraph *g = w->g;
+    int k = g->k;
+    size_t q;
+
+    size_t *first = malloc((k+1)*sizeof(size_t));
+    size_t *last = malloc((k+1)*sizeof(size_t));
+    first[0] = 0;
+    last[0] = g->nodes-1;
+    int depth = 0;
+    char *previous = NULL;
+
+    for(q = w->start; q < w->end; q++){
+        char *kmer = w->queries[q].kmer;
+        int shared = 0;
+        if(previous != NULL)
+            while(shared < depth && previous[shared] == kmer[shared]) shared++;
+        depth = shared;
+
+        while(depth < k){
+            first[depth+1] = first[depth];
+            last[depth+1] = last[depth];
+            if(!bossGraphExtend(g, &first[depth+1], &last[depth+1], kmer[depth]))
+                break;
+            depth++;
+        }
+        previous = kmer;
+
+        if(depth == k)
+            bossGraphNodeColors(g, first[k], w->found + w->queries[q].index*w->words);
+    }
+
+    free(first);
+    free(last);
+    return NULL;
+}
+
+static size_t processBatch(bossGraph *g, char **names, char *kmers, query *queries, size_t count, int threads, uint64_t *found, int words, FILE *output){
+    size_t i;
+    int t, j;
+    int k = g->k;
+    size_t foundQueries = 0;
+
+    memset(found, 0, count*words*sizeof(uint64_t));
+    qsort(queries, count, sizeof(query), compareQueries);
+
+    queryWorker *workers = malloc(threads*sizeof(queryWorker));
+    pthread_t *ids = malloc(threads*sizeof(pthread_t));
+    size_t chunk = (count+threads-1)/threads;
+    for(t = 0; t < threads; t++){
+        workers[t].g = g;
+        workers[t].queries = queries;
+        workers[t].start = MIN(t*chunk, count);
+        workers[t].end = MIN((t+1)*chunk, count);
+        workers[t].found = found;
+        workers[t].words = words;
+        if(threads == 1)
+            queryWorkerRun(&workers[t]);
+        else
+            pthread_create(&ids[t], NULL, queryWorkerRun, &workers[t]);
+    }
+    for(t = 0; t < threads && threads > 1; t++)
+        pthread_join(ids[t], NULL);
+
+    // results are written in the order the k-mers were read
+    for(i = 0; i < count; i++){
+        uint64_t *genomes = found + i*words;
+        fwrite(kmers + i*(k+1), sizeof(char), k, output);
+        fputc('\t', output);
+        int printed = 0;
+        for(j = 0; j < g->samples; j++){
+            if(genomes[j/64] & (1ULL << (j%64))){
+                fprintf(output, printed ? ",%s" : "%s", names[j]);
+                printed = 1;
+            }
+        }
+        if(printed) foundQueries++;
+        else fputc('-', output);
+        fputc('\n', output);
+    }
+
+    free(workers);
+    free(ids);
+    return foundQueries;
+}
+
+size_t queryKmers(bossFile *boss, char **names, char *queryFile, int threads, char *outputFile){
+    size_t i;
+    bossGraph *g = bossGraphCreate(boss);
+    if(g == NULL){
+        fprintf(stderr, "Unable to query k-mers from %s\n", queryFile);
+        return 0;
+    }
+    int k = g->k;
+    if(threads < 1) threads = 1;
+
+    // FASTA/FASTQ inputs are streamed into one sequence per line first
+    char normalizedFile[FILE_PATH];
+    char *sequencesFile = queryFile;
+    if(isSequenceFile(queryFile)){
+        char *name = strrchr(queryFile, '/');
+        snprintf(normalizedFile, FILE_PATH, "%s/%s.query.fasta", tmpDir, name ? name+1 : queryFile);
+        normalizeSequenceFile(queryFile, normalizedFile);
+        sequencesFile = normalizedFile;
+    }
+
+    FILE *sequences = fopen(sequencesFile, "r");
+    if(sequences == NULL){
+        fprintf(stderr, "Unable to read file %s\n", queryFile);
+        exit(-1);
+    }
+    FILE *output = fopen(outputFile, "w");
+    if(output == NULL){
+        fprintf(stderr, "Unable to write file %s\n", outputFile);
+        exit(-1);
+    }
+
+    int words = (g->samples+63)/64;
+    char *kmers = malloc((size_t)QUERY_BATCH*(k+1));
+    query *queries = malloc(QUERY_BATCH*sizeof(query));
+    uint64_t *found = malloc((size_t)QUERY_BATCH*words*sizeof(uint64_t));
+    size_t count = 0, total = 0, foundQueries = 0;
+
+    char *line = NULL;
+    size_t lineCapacity = 0;
+    ssize_t read;
+    while((read = getline(&line, &lineCapacity, sequences)) != -1){
+        if(line[0] == '>')
+            continue;
+        // normalize in place, dropping whitespace
+        ssize_t len = 0;
+        for(i = 0; i < (size_t)read; i++){
+            if(!isspace((unsigned char)line[i]))
+                line[len++] = normalizeBase(line[i]);
+        }
+        for(i = 0; i + k <= (size_t)len; i++){
+            char *kmer = kmers + count*(k+1);
+            memcpy(kmer, line+i, k);
+            kmer[k] = '\0';
+            queries[count].kmer = kmer;
+            queries[count].index = count;
+            count++;
+            if(count == QUERY_BATCH){
+                foundQueries += processBatch(g, names, kmers, queries, count, threads, found, words, output);
+                total += count;
+                count = 0;
+            }
+        }
+    }
+    if(count > 0){
+        foundQueries += processBatch(g, names, kmers, queries, count, threads, found, words, output);
+        total += count;
+    }
+
+    printf("%zu k-mers queried, %zu found in at least one genome\n", total, foundQueries);
+
+    free(line);
+    free(kmers);
+    free(queries);
+    free(found);
+    fclose(sequences);
+    fclose(output);
+    if(sequencesFile != queryFile)
+        remove(normalizedFile);
+    bossGraphFree(g);
+
+    return total;
+}
@@ -0,0 +1,7 @@
+#include "bossfile.h"
+
+/* Reports the genomes (names[color]) containing each k-mer of queryFile
+   in outputFile, in queryFile order. queryFile is a FASTA/FASTQ file or
+   a text file with one sequence per line, every k-mer of a sequence is
+   a query. Returns the number of queries */
+size_t queryKmers(bossFile *boss, char **names, char *queryFile, int threads, char *outputFile);
@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "sketch.h"
+#include "input.h"
+
+#define MIN(a,b) (((a)<(b))?(a):(b))
+#define MAX(a,b) (((a)>(b))?(a):(b))
+
+// hashes kept before the smallest SKETCH_SIZE of them are selected again
+#define SKETCH_BUFFER (4*SKETCH_SIZE)
+
+// kmer-mers of the read being scanned and the hashes kept so far
+typedef struct {
+    int kmer;
+    uint64_t mask;
+    uint64_t forward, reverse; // last kmer bases, and their reverse complement
+    int bases; // since the read start or the last N
+
+    uint64_t *buffer;
+    int count;
+    uint64_t threshold; // largest of the SKETCH_SIZE smallest hashes so far
+} sketchScan;
+
+// finalizer of MurmurHash3, the 2 bits k-mers are far from uniform
+static uint64_t hashKmer(uint64_t kmer){
+    kmer ^= kmer >> 33;
+    kmer *= 0xff51afd7ed558ccdULL;
+    kmer ^= kmer >> 33;
+    kmer *= 0xc4ceb9fe1a85ec53ULL;
+    kmer ^= kmer >> 33;
+    return kmer;
+}
+
+static int compareHashes(const void *a, const void *b){
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts the kept hashes without repetitions, up to SKETCH_SIZE of them
+static void selectHashes(sketchScan *s){
+    int i, count = 0;
+    qsort(s->buffer, s->count, sizeof(uint64_t), compareHashes);
+    for(i = 0; i < s->count && count < SKETCH_SIZE; i++){
+        if(count == 0 || s->buffer[i] != s->buffer[count-1])
+            s->buffer[count++] = s->buffer[i];
+    }
+    s->count = count;
+    if(count == SKETCH_SIZE)
+        s->threshold = s->buffer[count-1];
+}
+
+static void startRead(void *arg){
+    ((sketchScan*)arg)->bases = 0;
+}
+
+static void scanBases(char *line, void *arg){
+    sketchScan *s = (sketchScan*)arg;
+    int shift = 2*(s->kmer-1);
+    for(char *ch = line; *ch; ch++){
+        if(isspace((unsigned char)*ch))
+            continue;
+        uint64_t code;
+        switch(normalizeBase(*ch)){
+            case 'A': code = 0; break;
+            case 'C': code = 1; break;
+            case 'G': code = 2; break;
+            case 'T': code = 3; break;
+            default:
+                s->bases = 0;
+                continue;
+        }
+        s->forward = ((s->forward << 2) | code) & s->mask;
+        s->reverse = (s->reverse >> 2) | ((3-code) << shift);
+        if(++s->bases < s->kmer)
+            continue;
+
+        uint64_t hash = hashKmer(MIN(s->forward, s->reverse));
+        if(hash < s->threshold || s->count < SKETCH_SIZE){
+            s->buffer[s->count++] = hash;
+            if(s->count == SKETCH_BUFFER)
+                selectHashes(s);
+        }
+    }
+}
+
+sketch* sketchSequenceFile(char *inputFile, int kmer){
+    sketchScan s;
+    memset(&s, 0, sizeof(sketchScan));
+    s.kmer = MIN(MAX(kmer, 1), SKETCH_KMER_MAX);
+    s.mask = s.kmer == 32 ? UINT64_MAX : (1ULL << (2*s.kmer))-1;
+    s.threshold = UINT64_MAX;
+    s.buffer = malloc(SKETCH_BUFFER*sizeof(uint64_t));
+
+    readSequenceFile(inputFile, startRead, scanBases, &s);
+    selectHashes(&s);
+
+    sketch *result = malloc(sizeof(sketch));
+    result->kmer = s.kmer;
+    result->count = s.count;
+    result->hashes = realloc(s.buffer, MAX(s.count, 1)*sizeof(uint64_t));
+    return result;
+}
+
+int sketchWrite(sketch *s, char *fileName){
+    sketchHeader header;
+    FILE *f = fopen(fileName, "wb");
+    if(f == NULL)
+        return -1;
+    memcpy(header.magic, SKETCH_MAGIC, 8);
+    header.kmer = s->kmer;
+    header.count = s->count;
+    int status = fwrite(&header, sizeof(sketchHeader), 1, f) == 1 && fwrite(s->hashes, sizeof(uint64_t), s->count, f) == (size_t)s->count ? 0 : -1;
+    if(fclose(f) != 0)
+        status = -1;
+    return status;
+}
+
+sketch* sketchRead(char *fileName){
+    sketchHeader header;
+    FILE *f = fopen(fileName, "rb");
+    if(f == NULL)
+        return NULL;
+    if(fread(&header, sizeof(sketchHeader), 1, f) != 1 || memcmp(header.magic, SKETCH_MAGIC, 8) != 0 || header.count > SKETCH_SIZE){
+        fclose(f);
+        return NULL;
+    }
+    sketch *s = malloc(sizeof(sketch));
+    s->kmer = header.kmer;
+    s->count = header.count;
+    s->hashes = malloc(MAX(s->count, 1)*sizeof(uint64_t));
+    if(fread(s->hashes, sizeof(uint64_t), s->count, f) != (size_t)s->count){
+        sketchFree(s);
+        s = NULL;
+    }
+    fclose(f);
+    return s;
+}
+
+void sketchFree(sketch *s){
+    free(s->hashes);
+    free(s);
+}
+
+double sketchDistance(sketch *a, sketch *b){
+    int i = 0, j = 0, merged = 0, shared = 0;
+    // the smallest hashes of the union, and how many of them are in both
+    while(merged < SKETCH_SIZE && (i < a->count || j < b->count)){
+        if(j == b->count || (i < a->count && a->hashes[i] < b->hashes[j])){
+            i++;
+        } else if(i == a->count || b->hashes[j] < a->hashes[i]){
+            j++;
+        } else {
+            shared++;
+            i++;
+            j++;
+        }
+        merged++;
+    }
+    if(shared == 0)
+        return 1.0;
+    double jaccard = (double)shared/merged;
+    return MIN(1.0, MAX(0.0, -log(2*jaccard/(1+jaccard))/a->kmer));
+}
+
+typedef struct {
+    double distance;
+    int genome;
+} sketchNeighbor;
+
+static int compareNeighbors(const void *a, const void *b){
+    const sketchNeighbor *x = (const sketchNeighbor*)a, *y = (const sketchNeighbor*)b;
+    if(x->distance != y->distance)
+        return x->distance < y->distance ? -1 : 1;
+    return x->genome - y->genome;
+}
+
+int sketchCandidates(double **distances, int count, int nearest, double maxDistance, char *exact){
+    int i, j, marked = 0;
+    sketchNeighbor *neighbors = malloc(MAX(count, 1)*sizeof(sketchNeighbor));
+    memset(exact, 0, (size_t)count*count);
+
+    for(i = 0; i < count; i++){
+        int n = 0;
+        for(j = 0; j < count; j++){
+            if(j != i){
+                neighbors[n].distance = i < j ? distances[j][i] : distances[i][j];
+                neighbors[n++].genome = j;
+            }
+        }
+        qsort(neighbors, n, sizeof(sketchNeighbor), compareNeighbors);
+        for(j = 0; j < n && (j < nearest || (maxDistance >= 0 && neighbors[j].distance <= maxDistance)); j++){
+            int other = neighbors[j].genome;
+            char *pair = &exact[MIN(i, other)*count + MAX(i, other)];
+            marked += !*pair;
+            *pair = 1;
+        }
+    }
+
+    free(neighbors);
+    return marked;
+}
+
+void sketchFill(double **D, double **distances, int count, char *exact){
+    int i, j;
+    double n = 0, sumX = 0, sumY = 0, sumXX = 0, sumXY = 0;
+    double low = INFINITY, high = -INFINITY;
+    for(i = 0; i < count; i++){
+        for(j = i+1; j < count; j++){
+            if(exact[i*count+j]){
+                double x = distances[j][i], y = D[j][i];
+                n++;
+                sumX += x; sumY += y;
+                sumXX += x*x; sumXY += x*y;
+                low = MIN(low, y);
+                high = MAX(high, y);
+            }
+        }
+    }
+
+    // the sketch distance itself, unless there are exact values of 2 different distances at least
+    double slope = 1, intercept = 0;
+    double variance = n*sumXX - sumX*sumX;
+    if(n >= 2 && variance > 1e-12){
+        slope = (n*sumXY - sumX*sumY)/variance;
+        intercept = (sumY - slope*sumX)/n;
+    }
+
+    // the line is not extrapolated beyond the exact values
+    if(n == 0){
+        low = 0;
+        high = INFINITY;
+    }
+    for(i = 0; i < count; i++){
+        for(j = i+1; j < count; j++){
+            if(!exact[i*count+j])
+                D[j][i] = MIN(high, MAX(low, intercept + slope*distances[j][i]));
+        }
+    }
+}
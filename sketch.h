@@ -0,0 +1,59 @@
+#ifndef SKETCH_H
+#define SKETCH_H
+
+#include <stdint.h>
+
+/* MinHash sketch of an input: the SKETCH_SIZE smallest hashes of its
+   canonical kmer-mers (the smaller of a kmer-mer and its reverse
+   complement), kmer-mers with an N left out. The sketch file is
+     sketchHeader
+     uint64_t hashes[count], sorted
+ */
+
+#define SKETCH_MAGIC "GCBBSKCH"
+#define SKETCH_SIZE 1024
+
+// k-mers are packed in 2 bits per base
+#define SKETCH_KMER_MAX 32
+
+typedef struct {
+    char magic[8];
+    uint32_t kmer;
+    uint32_t count;
+} sketchHeader;
+
+typedef struct {
+    int kmer;
+    int count; // up to SKETCH_SIZE hashes
+    uint64_t *hashes;
+} sketch;
+
+// Sketch of the kmer-mers of inputFile, a sequence file as read by readSequenceFile
+sketch* sketchSequenceFile(char *inputFile, int kmer);
+
+// Returns 0 on success
+int sketchWrite(sketch *s, char *fileName);
+
+// NULL if fileName is not a sketch
+sketch* sketchRead(char *fileName);
+
+void sketchFree(sketch *s);
+
+/* Mash distance between the genomes of a and b, -ln(2J/(1+J))/kmer of the
+   Jaccard index J estimated by the SKETCH_SIZE smallest hashes of both
+   sketches. 1 if they share none of them */
+double sketchDistance(sketch *a, sketch *b);
+
+/* Marks in exact[i*count+j], i < j, the pairs of count genomes compared
+   exactly: the nearest ones of each genome by the sketch distances
+   (distances[j][i]), and the ones at most maxDistance apart (if it is not
+   negative). Returns how many pairs are marked */
+int sketchCandidates(double **distances, int count, int nearest, double maxDistance, char *exact);
+
+/* Fills D[j][i] of the pairs not compared exactly with their sketch
+   distance, scaled by the least squares line of the exact values of D on
+   the sketch distances, so both kinds of values are comparable. The
+   estimates are clamped to the range of the exact values */
+void sketchFill(double **D, double **distances, int count, char *exact);
+
+#endif
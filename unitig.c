@@ -0,0 +1,178 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "unitig.h"
+#include "graph.h"
+
+#define GET_BIT(bits, i) (((bits)[(i)/64] >> ((i)%64)) & 1)
+#define SET_BIT(bits, i) ((bits)[(i)/64] |= 1ULL << ((i)%64))
+
+typedef struct {
+    bossGraph *g;
+    char **names;
+    FILE *output;
+    uint64_t *padded;
+    uint64_t *visited;
+    uint64_t *genomes;
+    int words;
+    char *sequence;
+    size_t capacity;
+} unitigWriter;
+
+// $-padded vertices are the ones at less than k edges from the source vertex, they are not k-mers of any genome
+static uint64_t* paddedVertices(bossGraph *g){
+    size_t i, e;
+    int depth;
+    uint64_t *padded = calloc(g->nodes/64+1, sizeof(uint64_t));
+    if(g->nodes == 0)
+        return padded;
+
+    size_t capacity = 1024, levelStart = 0, levelEnd = 1;
+    size_t *queue = malloc(capacity*sizeof(size_t));
+    queue[0] = 0;
+    SET_BIT(padded, 0);
+
+    for(depth = 1; depth < g->k; depth++){
+        size_t size = levelEnd;
+        for(i = levelStart; i < levelEnd; i++){
+            size_t end = bossGraphNodeEnd(g, queue[i]);
+            for(e = bossGraphNodeStart(g, queue[i]); e <= end; e++){
+                size_t target = bossGraphForward(g, e);
+                if(target == BOSS_GRAPH_NONE || GET_BIT(padded, target))
+                    continue;
+                SET_BIT(padded, target);
+                if(size == capacity){
+                    capacity *= 2;
+                    queue = realloc(queue, capacity*sizeof(size_t));
+                }
+                queue[size++] = target;
+            }
+        }
+        levelStart = levelEnd;
+        levelEnd = size;
+    }
+
+    free(queue);
+    return padded;
+}
+
+// Indegree of v not counting $-padded predecessors, the last one found is stored in predecessor
+static int kmerIndegree(unitigWriter *w, size_t v, size_t *predecessor){
+    int indegree = 0;
+    size_t e = bossGraphBackward(w->g, v);
+    while(e != BOSS_GRAPH_NONE){
+        size_t u = bossGraphEdgeNode(w->g, e);
+        if(!GET_BIT(w->padded, u)){
+            indegree++;
+            *predecessor = u;
+        }
+        e = bossGraphNextIncoming(w->g, v, e);
+    }
+    return indegree;
+}
+
+static void appendSymbol(unitigWriter *w, size_t length, char symbol){
+    if(length == w->capacity){
+        w->capacity *= 2;
+        w->sequence = realloc(w->sequence, w->capacity);
+    }
+    w->sequence[length] = symbol;
+}
+
+// Follows the path from start while it does not branch, then writes it and the links leaving it
+static void writeUnitig(unitigWriter *w, size_t start){
+    bossGraph *g = w->g;
+    size_t e, predecessor;
+    int j;
+
+    bossGraphLabel(g, start, w->sequence);
+    size_t length = g->k;
+    memset(w->genomes, 0, w->words*sizeof(uint64_t));
+
+    size_t v = start;
+    SET_BIT(w->visited, v);
+    bossGraphNodeColors(g, v, w->genomes);
+    while(bossGraphOutdegree(g, v) == 1){
+        // $ is the first edge of a vertex, so its only other edge is the last one
+        e = bossGraphNodeEnd(g, v);
+        size_t next = bossGraphForward(g, e);
+        if(next == start || GET_BIT(w->visited, next) || kmerIndegree(w, next, &predecessor) != 1)
+            break;
+        appendSymbol(w, length++, bossGraphSymbol(g, e));
+        v = next;
+        SET_BIT(w->visited, v);
+        bossGraphNodeColors(g, v, w->genomes);
+    }
+
+    fprintf(w->output, "S\t%zu\t%.*s\tLN:i:%zu\tCL:Z:", start, (int)length, w->sequence, length);
+    int printed = 0;
+    for(j = 0; j < g->samples; j++){
+        if(GET_BIT(w->genomes, j)){
+            fprintf(w->output, printed ? ",%s" : "%s", w->names[j]);
+            printed = 1;
+        }
+    }
+    fputc('\n', w->output);
+
+    // the targets of the last vertex start unitigs, which are named after their first vertex
+    size_t end = bossGraphNodeEnd(g, v);
+    for(e = bossGraphNodeStart(g, v); e <= end; e++){
+        size_t target = bossGraphForward(g, e);
+        if(target != BOSS_GRAPH_NONE)
+            fprintf(w->output, "L\t%zu\t+\t%zu\t+\t%dM\n", start, target, g->k-1);
+    }
+}
+
+size_t writeUnitigs(bossFile *boss, char **names, char *outputFile){
+    size_t v, predecessor;
+    size_t unitigs = 0;
+    unitigWriter w;
+
+    w.g = bossGraphCreate(boss);
+    if(w.g == NULL){
+        fprintf(stderr, "Unable to compute unitigs of %s\n", outputFile);
+        return 0;
+    }
+    w.output = fopen(outputFile, "w");
+    if(w.output == NULL){
+        fprintf(stderr, "Unable to write file %s\n", outputFile);
+        exit(-1);
+    }
+    bossGraph *g = w.g;
+    w.names = names;
+    w.padded = paddedVertices(g);
+    w.visited = calloc(g->nodes/64+1, sizeof(uint64_t));
+    w.words = (g->samples+63)/64;
+    w.genomes = malloc(w.words*sizeof(uint64_t));
+    w.capacity = 2*g->k+1;
+    w.sequence = malloc(w.capacity);
+
+    fprintf(w.output, "H\tVN:Z:1.0\n");
+
+    // unitigs start where the path branches: no single predecessor, or a predecessor with other successors
+    for(v = 0; v < g->nodes; v++){
+        if(GET_BIT(w.padded, v) || GET_BIT(w.visited, v))
+            continue;
+        if(kmerIndegree(&w, v, &predecessor) != 1 || bossGraphOutdegree(g, predecessor) != 1){
+            writeUnitig(&w, v);
+            unitigs++;
+        }
+    }
+
+    // what is left are cycles without branches
+    for(v = 0; v < g->nodes; v++){
+        if(GET_BIT(w.padded, v) || GET_BIT(w.visited, v))
+            continue;
+        writeUnitig(&w, v);
+        unitigs++;
+    }
+
+    fclose(w.output);
+    free(w.padded);
+    free(w.visited);
+    free(w.genomes);
+    free(w.sequence);
+    bossGraphFree(g);
+
+    return unitigs;
+}
@@ -0,0 +1,7 @@
+#include "bossfile.h"
+
+/* Writes the unitigs (maximal non-branching paths) of the BOSS as GFA
+   segments to outputFile, each one with the genomes (names[color]) of
+   its k-mers, plus the links between them. Returns the number of
+   unitigs */
+size_t writeUnitigs(bossFile *boss, char **names, char *outputFile);